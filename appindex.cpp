@@ -0,0 +1,43 @@
+#include "appindex.h"
+#include <algorithm>
+
+void AppIndex::Clear() {
+	byName.clear();
+	sorted.clear();
+	sortedStale = false;
+}
+
+void AppIndex::Build(const std::vector<AppRecord>& apps) {
+	Clear();
+	Append(apps, 0);
+}
+
+void AppIndex::Append(const std::vector<AppRecord>& apps, size_t from) {
+	byName.reserve(apps.size());
+	for (size_t i = from; i < apps.size(); ++i)
+		byName.emplace(FoldCase(apps[i].name), i); // the first of equal names wins
+	sortedStale = true;
+}
+
+size_t AppIndex::Find(const std::wstring& name) const {
+	auto it = byName.find(FoldCase(name));
+	return it == byName.end() ? NONE : it->second;
+}
+
+void AppIndex::WithPrefix(const std::wstring& prefix, std::vector<size_t>& positions) {
+	if (sortedStale) {
+		sorted.assign(byName.begin(), byName.end());
+		std::sort(sorted.begin(), sorted.end());
+		sortedStale = false;
+	}
+
+	// names with the prefix are one run of the sorted list
+	std::wstring folded = FoldCase(prefix);
+	auto first = std::lower_bound(sorted.begin(), sorted.end(), folded, [](const std::pair<std::wstring, size_t>& entry, const std::wstring& value) {
+		return entry.first < value;
+	});
+	size_t begin = positions.size();
+	for (auto it = first; it != sorted.end() && it->first.compare(0, folded.size(), folded) == 0; ++it)
+		positions.push_back(it->second);
+	std::sort(positions.begin() + begin, positions.end());
+}
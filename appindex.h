@@ -0,0 +1,32 @@
+#pragma once
+
+#include "store.h"
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Name lookups over the app list the main window shows, so neither the duplicate check
+// nor the type-ahead filter walks every row:
+// - a case-folded hash table for "is this app listed, and where"
+// - the folded names sorted, for the apps whose name starts with what was typed
+// Positions are indices into the vector the index was built from; rebuild after
+// inserting or erasing, Append after adding at the end.
+class AppIndex {
+public:
+	static constexpr size_t NONE = (size_t)-1;
+
+	void Clear();
+	void Build(const std::vector<AppRecord>& apps);
+	void Append(const std::vector<AppRecord>& apps, size_t from);
+
+	size_t Find(const std::wstring& name) const; // NONE when not listed
+
+	// Every position whose name starts with prefix (any case), ascending
+	void WithPrefix(const std::wstring& prefix, std::vector<size_t>& positions);
+
+private:
+	std::unordered_map<std::wstring, size_t> byName;    // folded name -> position
+	std::vector<std::pair<std::wstring, size_t>> sorted; // folded name, position
+	bool sortedStale = false;                            // sorted is rebuilt on first use
+};
@@ -0,0 +1,325 @@
+// Benchmarks for the paths that grow with the number of IFEO keys, run against a synthetic
+// in-memory tree so they work anywhere the portable build does (proc_sweep, over a synthetic
+// /proc with one process per key, on Linux only):
+//   setpriority-bench [--only NAME] [--min-ms N] [ENTRIES...]   (default 1000 10000 100000)
+// One JSON object per line on stdout, for tracking across releases:
+//   {"benchmark":"list_apps","entries":10000,"iterations":42,"ns_per_op":...,"allocs_per_op":...,"bytes_per_op":...}
+// An op is one call of what the name says: a whole enumeration for get_apps, a single
+// name for the lookups.
+#include "appindex.h"
+#include "enforce.h"
+#include "profiles.h"
+#include "regfile.h"
+#include "snapcache.h"
+#include "store.h"
+#include "sweep.h"
+#include "sysapps.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <vector>
+
+static std::atomic<uint64_t> AllocCount{ 0 };
+static std::atomic<uint64_t> AllocBytes{ 0 };
+
+void* operator new(size_t size) {
+	AllocCount.fetch_add(1, std::memory_order_relaxed);
+	AllocBytes.fetch_add(size, std::memory_order_relaxed);
+	if (void* p = malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+struct Options {
+	std::string only;
+	long long minNs = 200000000; // keep repeating a benchmark for at least this long
+	std::vector<size_t> sizes;
+};
+
+// Run body (which performs opsPerCall ops) until minNs has passed, then print one line
+template <typename Body>
+static void Measure(const Options& options, const char* name, size_t entries, size_t opsPerCall, Body body) {
+	if (!options.only.empty() && options.only != name) return;
+
+	body(); // warm up: first-touch allocations and caches are not what we track
+	uint64_t allocs = AllocCount, bytes = AllocBytes;
+	auto start = std::chrono::steady_clock::now();
+	long long elapsed = 0;
+	size_t iterations = 0;
+	do {
+		body();
+		++iterations;
+		elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	} while (elapsed < options.minNs || iterations < 3);
+
+	double ops = double(iterations) * double(opsPerCall);
+	printf("{\"benchmark\":\"%s\",\"entries\":%zu,\"iterations\":%zu,\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f,\"bytes_per_op\":%.1f}\n",
+		name, entries, iterations, double(elapsed) / ops, double(AllocCount - allocs) / ops, double(AllocBytes - bytes) / ops);
+	fflush(stdout);
+}
+
+// A plausible IFEO tree: mostly managed apps with a spread of settings, some bare keys
+// (debugger entries and the like), and a slice of names that ship with the OS
+static std::vector<AppRecord> SyntheticTree(size_t entries) {
+	static const wchar_t* systemNames[] = { L"ls", L"cat", L"bash", L"notepad.exe", L"svchost.exe", L"cmd.exe" };
+	std::vector<AppRecord> tree;
+	tree.reserve(entries);
+	for (size_t i = 0; i < entries; ++i) {
+		AppRecord record;
+		wchar_t name[64];
+		if (i % 50 == 0)
+			swprintf(name, 64, L"%ls-%zu", systemNames[(i / 50) % std::size(systemNames)], i);
+		else
+			swprintf(name, 64, L"App%07zu.exe", i);
+		record.name = name;
+		if (i % 10 != 0) {
+			record.perfOptions = true;
+			record.managed = i % 7 != 0;
+			record.hasPriority = i % 3 != 0;
+			record.priority = DWORD(1 + i % 6);
+			record.hasIoPriority = i % 4 == 0;
+			record.ioPriority = DWORD(i % 4);
+			if (i % 16 == 0) record.cpuSet = L"0-3";
+		}
+		tree.push_back(std::move(record));
+	}
+	return tree;
+}
+
+#ifndef _WIN32
+// A stand-in for /proc with one directory per PID up to pids: a comm file each, and a stat
+// file for every 100th, whose comm is one of the tree's managed apps. The rest match nothing,
+// as on a host where most processes are not managed.
+static void SyntheticProc(const std::filesystem::path& root, const std::vector<AppRecord>& tree, size_t pids) {
+	std::error_code ignored;
+	std::filesystem::remove_all(root, ignored);
+	std::filesystem::create_directories(root);
+	size_t app = 0;
+	for (size_t pid = 1; pid <= pids; ++pid) {
+		std::filesystem::path dir = root / std::to_string(pid);
+		std::filesystem::create_directory(dir);
+		std::string comm = "proc-" + std::to_string(pid);
+		bool managed = false;
+		if (pid % 100 == 0) {
+			while (app < tree.size() && !tree[app].managed) ++app;
+			if (app < tree.size()) {
+				comm = WideToUtf8(tree[app++].name);
+				if (comm.size() > 4 && comm.compare(comm.size() - 4, 4, ".exe") == 0) comm.resize(comm.size() - 4);
+				comm.resize((std::min)(comm.size(), COMM_LEN));
+				managed = true;
+			}
+		}
+		FILE* file = fopen((dir / "comm").c_str(), "w");
+		if (!file) abort();
+		fprintf(file, "%s\n", comm.c_str());
+		fclose(file);
+		if (!managed) continue;
+
+		// fields 3..41: state, then zeros except nice (19) 0, num_threads (20) 1, policy (41) 0
+		file = fopen((dir / "stat").c_str(), "w");
+		if (!file) abort();
+		fprintf(file, "%zu (%s) S", pid, comm.c_str());
+		for (int index = 4; index <= 52; ++index)
+			fprintf(file, " %d", index == 20 ? 1 : 0);
+		fprintf(file, "\n");
+		fclose(file);
+	}
+}
+#endif
+
+static void RunSize(const Options& options, size_t entries, SystemAppClassifier& systemApps) {
+	std::vector<AppRecord> tree = SyntheticTree(entries);
+	MemoryStore store;
+	for (const auto& record : tree)
+		store.Put(record);
+
+	Measure(options, "get_apps", entries, 1, [&] {
+		std::vector<std::wstring> names = store.GetApps();
+		if (names.size() != entries) abort();
+	});
+
+	Measure(options, "load_snapshot", entries, 1, [&] {
+		std::vector<AppRecord> snapshot = store.LoadSnapshot();
+		if (snapshot.size() != entries) abort();
+	});
+
+	// what the main window does on a refresh: read, classify, index, pick the visible rows
+	Measure(options, "list_apps", entries, 1, [&] {
+		std::vector<AppRecord> apps = store.LoadSnapshot();
+		for (auto& app : apps)
+			app.system = systemApps.Contains(app.name);
+		AppIndex index;
+		index.Build(apps);
+		std::vector<size_t> rows;
+		for (size_t i = 0; i < apps.size(); ++i) {
+			if (apps[i].managed && !apps[i].system) rows.push_back(i);
+		}
+	});
+
+	Measure(options, "is_system_app", entries, entries, [&] {
+		size_t system = 0;
+		for (const auto& record : tree)
+			system += systemApps.Contains(record.name);
+		(void)system;
+	});
+
+	AppIndex index;
+	index.Build(tree);
+	Measure(options, "find_app", entries, entries, [&] {
+		for (const auto& record : tree) {
+			if (index.Find(record.name) == AppIndex::NONE) abort();
+		}
+	});
+
+	Measure(options, "filter_prefix", entries, 1, [&] {
+		std::vector<size_t> rows;
+		index.WithPrefix(L"app0001", rows); // a few keystrokes in
+	});
+
+	// the enforcer's per-process lookup, by comm as the kernel reports it
+	RuleTable rules;
+	rules.Build(tree);
+	std::vector<std::string> comms;
+	for (size_t i = 0; i < entries; i += 7) {
+		std::string comm = WideToUtf8(tree[i].name);
+		comms.push_back(comm.substr(0, COMM_LEN));
+	}
+	Measure(options, "rule_find", entries, comms.size(), [&] {
+		size_t matched = 0;
+		for (const auto& comm : comms)
+			matched += rules.Find(comm) != nullptr;
+		(void)matched;
+	});
+
+#ifndef _WIN32
+	// one enforcement pass over a host with as many processes as keys; the hook holds every
+	// match, so the pass reads what a real one would but touches no live process. The files
+	// sit on a regular filesystem, which is cheaper to read than the procfs it stands in for.
+	if (options.only.empty() || options.only == "proc_sweep") {
+		std::filesystem::path procRoot = std::filesystem::temp_directory_path() / "setpriority-bench-proc";
+		SyntheticProc(procRoot, tree, entries);
+		ProcSweeper sweeper(procRoot.c_str());
+		auto hold = [](int, const RuleTable::Rule&) { return EnforceResult::Held; };
+		Measure(options, "proc_sweep", entries, 1, [&] {
+			EnforceStats stats = sweeper.Sweep(rules, hold);
+			if (stats.scanned != entries || stats.held == 0) abort();
+		});
+		std::error_code ignored;
+		std::filesystem::remove_all(procRoot, ignored);
+	}
+#endif
+
+	Measure(options, "bulk_set_priority", entries, 1, [&] {
+		WriteBatch batch;
+		for (size_t i = 0; i < entries; ++i)
+			batch.SetPriority(tree[i].name, DWORD(1 + (i + 1) % 6));
+		if (!store.Commit(batch)) abort();
+	});
+
+	// a profile that differs from the store in 1% of its apps: read, diff, write the 1%
+	std::vector<AppRecord> profile;
+	for (size_t i = 0; i < entries; ++i) {
+		if (!tree[i].perfOptions || !tree[i].managed) continue;
+		profile.push_back(tree[i]);
+		if (i % 100 == 1) profile.back().priority = DWORD(1 + (tree[i].priority + 1) % 6);
+	}
+	Measure(options, "profile_switch", entries, 1, [&] {
+		WriteBatch batch;
+		PlanProfileSwitch(store.LoadSnapshot(), profile, batch);
+		if (!store.Commit(batch)) abort();
+	});
+
+	// what the window shows before its first registry read
+	std::filesystem::path cacheFile = std::filesystem::temp_directory_path() / "setpriority-bench.bin";
+	SnapshotCache cache(cacheFile);
+	if (!cache.Save(tree)) abort();
+	Measure(options, "snapshot_cache_load", entries, 1, [&] {
+		std::vector<AppRecord> apps;
+		if (!cache.Load(apps) || apps.size() != entries) abort();
+	});
+
+	// the tree as `reg export` would write it: UTF-16LE, one key per app and per PerfOptions
+	std::filesystem::path regFile = std::filesystem::temp_directory_path() / "setpriority-bench.reg";
+	{
+		std::wstring text = L"\uFEFFWindows Registry Editor Version 5.00\r\n\r\n";
+		const std::wstring root = std::wstring(L"[HKEY_LOCAL_MACHINE\\") + IFEO_PATH + L"\\";
+		wchar_t value[64];
+		for (const auto& record : tree) {
+			text += root + record.name + L"]\r\n\r\n";
+			if (!record.perfOptions) continue;
+			text += root + record.name + L"\\PerfOptions]\r\n";
+			if (record.hasPriority) {
+				swprintf(value, 64, L"\"%ls\"=dword:%08x\r\n", RegPriority, (unsigned)record.priority);
+				text += value;
+			}
+			swprintf(value, 64, L"\"%ls\"=dword:%08x\r\n\r\n", RegManaged, record.managed ? 1u : 0u);
+			text += value;
+		}
+		std::string bytes;
+		for (wchar_t c : text) { // all BMP
+			bytes += char(c & 0xFF);
+			bytes += char((c >> 8) & 0xFF);
+		}
+		FILE* file = fopen(regFile.string().c_str(), "wb");
+		if (!file || fwrite(bytes.data(), 1, bytes.size(), file) != bytes.size()) abort();
+		fclose(file);
+	}
+	Measure(options, "regfile_load", entries, 1, [&] {
+		RegFileStore dump(regFile);
+		if (!dump.Load() || dump.Count() != entries) abort();
+	});
+
+	// the same through FileStore: journal append and fsync, compacted past JOURNAL_LIMIT
+	std::filesystem::path file = std::filesystem::temp_directory_path() / "setpriority-bench.txt";
+	{
+		FileStore fileStore(file);
+		fileStore.SetAutoSave(false);
+		for (const auto& record : tree)
+			fileStore.Put(record);
+		fileStore.SetAutoSave(true);
+		fileStore.Save();
+		Measure(options, "bulk_set_priority_file", entries, 1, [&] {
+			WriteBatch batch;
+			for (size_t i = 0; i < entries; ++i)
+				batch.SetPriority(tree[i].name, DWORD(1 + (i + 2) % 6));
+			if (!fileStore.Commit(batch)) abort();
+		});
+	}
+	std::error_code ignored;
+	std::filesystem::remove(file, ignored);
+	std::filesystem::remove(cacheFile, ignored);
+	std::filesystem::remove(regFile, ignored);
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--only") == 0 && i + 1 < argc)
+			options.only = argv[++i];
+		else if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc)
+			options.minNs = atoll(argv[++i]) * 1000000;
+		else if (size_t entries = strtoul(argv[i], nullptr, 10))
+			options.sizes.push_back(entries);
+		else {
+			fprintf(stderr, "Usage: setpriority-bench [--only NAME] [--min-ms N] [ENTRIES...]\n");
+			return 2;
+		}
+	}
+	if (options.sizes.empty())
+		options.sizes = { 1000, 10000, 100000 };
+
+	SystemAppClassifier systemApps(DefaultSystemDirectories());
+	systemApps.Refresh();
+	for (size_t entries : options.sizes)
+		RunSize(options, entries, systemApps);
+	return 0;
+}
@@ -0,0 +1,256 @@
+#ifndef _WIN32
+#include "cgroup.h"
+#include "trace.h"
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <set>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr auto SLICE_PREFIX = "app-";
+constexpr auto LEAF_NAME = "setpriority";
+constexpr unsigned CPU_PERIOD_US = 100000;
+
+DWORD CgroupWeight(const RuleTable::Rule& rule) {
+	if (rule.cpuWeight) return rule.cpuWeight;
+	if (rule.hasSched || rule.Governed()) { // governed: the weight of its base class
+		switch (rule.priority)
+		{
+		case 1: return 1;     // Idle
+		case 5: return 10;    // Below Normal
+		case 2: return 100;   // Normal
+		case 6: return 300;   // Above Normal
+		case 3: return 930;   // High
+		case 4: return 10000; // Realtime
+		}
+	}
+	return rule.cpuQuota ? 100 : 0;
+}
+
+// Whole small file; false (errno set) when it cannot be read
+static bool ReadText(const std::string& path, std::string& text) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	text.clear();
+	char buffer[4096];
+	ssize_t length;
+	while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+		text.append(buffer, (size_t)length);
+	int saved = errno;
+	close(fd);
+	errno = saved;
+	return length == 0;
+}
+
+// One write, the way cgroup files want it; false with errno from the kernel
+static bool WriteText(const std::string& path, const std::string& text) {
+	int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	bool ok = write(fd, text.data(), text.size()) == (ssize_t)text.size();
+	int saved = errno;
+	close(fd);
+	errno = saved;
+	return ok;
+}
+
+// The cgroup of a process below the cgroup2 mount ("0::/path"); empty when it is gone
+static std::string ProcessCgroup(const std::string& pid) {
+	std::string text;
+	if (!ReadText("/proc/" + pid + "/cgroup", text)) return std::string();
+	size_t line = text.find("0::");
+	if (line == std::string::npos) return std::string();
+	size_t end = text.find('\n', line);
+	return text.substr(line + 3, end == std::string::npos ? std::string::npos : end - line - 3);
+}
+
+static std::string Cgroup2Mount() {
+	FILE* mounts = fopen("/proc/self/mounts", "r");
+	if (!mounts) return std::string();
+	char line[4096], device[256], point[3072], type[64];
+	std::string found;
+	while (fgets(line, sizeof(line), mounts)) {
+		if (sscanf(line, "%255s %3071s %63s", device, point, type) == 3 && strcmp(type, "cgroup2") == 0) {
+			found = point;
+			break;
+		}
+	}
+	fclose(mounts);
+	return found;
+}
+
+static bool HasWord(const std::string& text, const char* word) {
+	size_t length = strlen(word);
+	for (size_t at = text.find(word); at != std::string::npos; at = text.find(word, at + 1)) {
+		bool before = at == 0 || text[at - 1] == ' ';
+		bool after = at + length == text.size() || text[at + length] == ' ' || text[at + length] == '\n';
+		if (before && after) return true;
+	}
+	return false;
+}
+
+// A rule key as a directory name: comm may hold '/' and other characters cgroupfs rejects
+static std::string SliceName(const std::string& key) {
+	std::string name = SLICE_PREFIX;
+	for (char c : key)
+		name += (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '.' ? c : '_';
+	return name;
+}
+
+// Move every process listed in from/cgroup.procs to the to cgroup. Processes that exit
+// meanwhile are not an error.
+static bool MoveAll(const std::string& from, const std::string& to) {
+	std::string procs;
+	if (!ReadText(from + "/cgroup.procs", procs)) return false;
+	bool ok = true;
+	for (size_t begin = 0, end; begin < procs.size(); begin = end + 1) {
+		end = procs.find('\n', begin);
+		if (end == std::string::npos) end = procs.size();
+		if (end > begin && !WriteText(to + "/cgroup.procs", procs.substr(begin, end - begin)) && errno != ESRCH)
+			ok = false;
+	}
+	return ok;
+}
+
+bool CgroupManager::Open(const std::string& requested, std::string& error) {
+	std::string mount = Cgroup2Mount();
+	if (mount.empty()) {
+		error = "no cgroup2 file system is mounted";
+		return false;
+	}
+
+	if (requested.empty()) {
+		relative = ProcessCgroup("self");
+		if (relative.empty()) {
+			error = "cannot tell which cgroup this process runs in";
+			return false;
+		}
+		root = mount + (relative == "/" ? "" : relative);
+	}
+	else {
+		char resolved[PATH_MAX];
+		if (!realpath(requested.c_str(), resolved)) {
+			error = requested + ": " + strerror(errno);
+			return false;
+		}
+		root = resolved;
+		if (root.compare(0, mount.size(), mount) != 0 || (root.size() > mount.size() && root[mount.size()] != '/')) {
+			error = root + " is not below the cgroup2 mount " + mount;
+			return false;
+		}
+		relative = root.size() == mount.size() ? "/" : root.substr(mount.size());
+	}
+
+	std::string controllers;
+	if (!ReadText(root + "/cgroup.controllers", controllers) || !HasWord(controllers, "cpu")) {
+		error = "the cpu controller is not available in " + root + " (not delegated to this user?)";
+		return false;
+	}
+
+	// no internal processes: once the children get a controller, ROOT itself may hold none
+	leaf = root + "/" + LEAF_NAME;
+	if (mkdir(leaf.c_str(), 0755) != 0 && errno != EEXIST) {
+		error = leaf + ": " + strerror(errno);
+		return false;
+	}
+	if (!MoveAll(root, leaf)) {
+		error = "cannot move the processes of " + root + " to " + leaf + ": " + strerror(errno);
+		return false;
+	}
+
+	std::string enabled;
+	if (!ReadText(root + "/cgroup.subtree_control", enabled) ||
+		(!HasWord(enabled, "cpu") && !WriteText(root + "/cgroup.subtree_control", "+cpu"))) {
+		error = "cannot enable the cpu controller in " + root + ": " + strerror(errno);
+		return false;
+	}
+	slices.clear();
+	return true;
+}
+
+bool CgroupManager::Release(const std::string& name) {
+	std::string path = root + "/" + name;
+	MoveAll(path, leaf);
+	return rmdir(path.c_str()) == 0 || errno == ENOENT;
+}
+
+size_t CgroupManager::Sync(const RuleTable& rules, std::string& error) {
+	TRACE_SCOPE("enforce", "CgroupManager::Sync");
+	std::map<std::string, Slice> wanted;
+	std::set<std::string> names;
+	for (const RuleTable::Rule& rule : rules.Rules()) {
+		DWORD weight = CgroupWeight(rule);
+		if (!weight) continue;
+
+		// keys that sanitize to the same name share the first one's cgroup settings
+		std::string name = SliceName(rule.key);
+		Slice slice;
+		slice.path = root + "/" + name;
+		slice.relative = (relative == "/" ? "" : relative) + "/" + name;
+		auto known = slices.find(rule.key);
+		if (known != slices.end() && known->second.path == slice.path) {
+			slice.weight = known->second.weight;
+			slice.quota = known->second.quota;
+		}
+		if (!names.insert(name).second) {
+			wanted.emplace(rule.key, slice);
+			continue;
+		}
+
+		if (mkdir(slice.path.c_str(), 0755) != 0 && errno != EEXIST) {
+			error = slice.path + ": " + strerror(errno);
+			continue;
+		}
+		if (slice.weight != weight) {
+			if (WriteText(slice.path + "/cpu.weight", std::to_string(weight)))
+				slice.weight = weight;
+			else
+				error = slice.path + "/cpu.weight: " + strerror(errno);
+		}
+		// quota 0 is written once too: an existing cgroup may carry a limit from an earlier run
+		DWORD quota = rule.cpuQuota ? rule.cpuQuota : (DWORD)-1;
+		if (slice.quota != quota) {
+			std::string max = rule.cpuQuota
+				? std::to_string((unsigned long long)rule.cpuQuota * CPU_PERIOD_US / 100) + " " + std::to_string(CPU_PERIOD_US)
+				: "max " + std::to_string(CPU_PERIOD_US);
+			if (WriteText(slice.path + "/cpu.max", max))
+				slice.quota = quota;
+			else
+				error = slice.path + "/cpu.max: " + strerror(errno);
+		}
+		wanted.emplace(rule.key, slice);
+	}
+
+	// whatever app cgroup no rule wants anymore, including leftovers from an earlier run
+	if (DIR* dir = opendir(root.c_str())) {
+		while (dirent* entry = readdir(dir)) {
+			if (entry->d_type == DT_DIR && strncmp(entry->d_name, SLICE_PREFIX, strlen(SLICE_PREFIX)) == 0 &&
+				!names.count(entry->d_name) && !Release(entry->d_name))
+				error = root + "/" + entry->d_name + ": " + strerror(errno);
+		}
+		closedir(dir);
+	}
+
+	slices.swap(wanted);
+	return names.size();
+}
+
+EnforceResult CgroupManager::Place(int pid, const RuleTable::Rule& rule) {
+	TRACE_SCOPE("enforce", "CgroupManager::Place");
+	auto slice = slices.find(rule.key);
+	if (slice == slices.end()) return EnforceResult::Unchanged;
+
+	std::string id = std::to_string(pid);
+	std::string current = ProcessCgroup(id);
+	if (current.empty()) return EnforceResult::Gone;
+	if (current == slice->second.relative) return EnforceResult::Unchanged;
+
+	if (!WriteText(slice->second.path + "/cgroup.procs", id))
+		return errno == ESRCH ? EnforceResult::Gone : EnforceResult::Failed;
+	return EnforceResult::Applied;
+}
+#endif
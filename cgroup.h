@@ -0,0 +1,55 @@
+#pragma once
+
+#include "enforce.h"
+
+// cgroup v2 CPU control for the Linux enforcer. nice only orders threads against each other;
+// a cgroup per app shares the CPU between apps however many threads each one runs, and can
+// cap it. Under a root we own:
+//   ROOT/cgroup.subtree_control   "+cpu"
+//   ROOT/setpriority/             leaf for what ran in ROOT itself (us) and for released processes
+//   ROOT/app-<key>/cpu.weight     rule's weight=, else derived from its priority class
+//   ROOT/app-<key>/cpu.max        rule's quota=, else "max"
+// The root defaults to the cgroup we run in, which is what delegation gives an unprivileged
+// user (systemd-run --user --scope -p Delegate=yes). Moving a process takes write access to
+// cgroup.procs of the common ancestor of both cgroups, so without root only processes that
+// already run inside the delegated subtree can be placed.
+#ifndef _WIN32
+#include <map>
+#include <string>
+
+// cpu.weight for the rule, 0 when it gets no cgroup (neither priority, weight nor quota):
+// Idle 1, Below Normal 10, Normal 100, Above Normal 300, High 930, Realtime 10000 -- the
+// kernel's own weights for the nice values MapPriorityClass picks, scaled to cpu.weight
+DWORD CgroupWeight(const RuleTable::Rule& rule);
+
+class CgroupManager {
+public:
+	// Take over root (empty: the cgroup this process runs in) and enable the cpu controller
+	// for its children. False with a reason when it is not ours to manage.
+	bool Open(const std::string& root, std::string& error);
+	const std::string& Root() const { return root; }
+
+	// Create or update a cgroup for every rule that has a weight, and release the cgroups
+	// of rules that are gone: their processes go back to the leaf and the cgroup is removed.
+	// Returns the number of app cgroups.
+	size_t Sync(const RuleTable& rules, std::string& error);
+
+	// Move the whole process into the rule's cgroup unless it is already there
+	EnforceResult Place(int pid, const RuleTable::Rule& rule);
+
+private:
+	struct Slice {
+		std::string path;     // absolute
+		std::string relative; // as /proc/<pid>/cgroup shows it
+		DWORD weight = 0;
+		DWORD quota = 0;
+	};
+
+	bool Release(const std::string& name);
+
+	std::string root;              // absolute path of ROOT
+	std::string relative;          // ROOT below the cgroup2 mount
+	std::string leaf;              // ROOT/setpriority
+	std::map<std::string, Slice> slices; // by rule key
+};
+#endif
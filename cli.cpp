@@ -0,0 +1,572 @@
+#include "cli.h"
+#include "cgroup.h"
+#include "enforce.h"
+#include "governor.h"
+#include "procevents.h"
+#include "profiles.h"
+#include "regfile.h"
+#include "sweep.h"
+#include "rules.h"
+#include "trace.h"
+#include "watchdog.h"
+#include <algorithm>
+#include <chrono>
+#include <cwctype>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#ifndef _WIN32
+#include <sched.h>
+#endif
+
+static const wchar_t* USAGE =
+	L"Usage: SetPriority [--store FILE] COMMAND...\n"
+	L"  --list [--all]       print managed apps (--all: every IFEO key) as rule lines\n"
+	L"  --get APP            print the rule line for one app\n"
+	L"  --set APP=PRIORITY   set Idle, Below Normal, Normal, Above Normal, High, Realtime\n"
+	L"                       or Default; append \",unmanaged\" to leave it unmanaged\n"
+	L"                       \",cpus=0-3,8\" pins it to CPUs, \",node=N\" to a NUMA node\n"
+	L"                       \",weight=N\" (1-10000) and \",quota=PERCENT\" set its cgroup share\n"
+	L"                       \",min=PRIORITY\" and \",max=PRIORITY\" bound what --govern may do\n"
+	L"                       \",threads=NAME:PRIORITY;...\" gives named threads their own class\n"
+	L"  --apply FILE         apply one rule per line (\"-\" reads stdin, # starts a comment)\n"
+	L"  --import FILE        same as --apply\n"
+	L"  --export FILE [--all] write managed apps (--all: unmanaged too) as a rule file\n"
+	L"  --remove APP         delete its PerfOptions, and its IFEO key if nothing else is left\n"
+	L"  --profiles           list the saved profiles\n"
+	L"  --save-profile NAME  save the managed apps as profile NAME\n"
+	L"  --profile NAME|FILE  switch to a profile: only apps whose settings differ are\n"
+	L"                       written, managed apps it leaves out are unmanaged, and\n"
+	L"                       nothing changes unless all of it can\n"
+	L"  --store FILE         use a file-backed store instead of the registry; a .reg\n"
+	L"                       export (reg export / regedit) is opened read-only\n"
+	L"  --trace FILE         time store calls and enforcement; write a Chrome trace\n"
+	L"                       (chrome://tracing, Perfetto) to FILE and print a summary\n"
+	L"  --enforce [--watch SECONDS] [--cgroup [DIR]] [--watchdog]\n"
+	L"                       apply the rules to running processes (on Windows only\n"
+	L"                       thread rules, the rest applies at start); --watch\n"
+	L"                       also catches new ones as they start and rereads the\n"
+	L"                       rules every SECONDS; --cgroup puts each app in its own\n"
+	L"                       cgroup v2 under DIR (default: the cgroup we run in);\n"
+	L"                       --watchdog (with --watch) demotes a High or Realtime app\n"
+	L"                       that starves a CPU to Normal for 30 seconds\n"
+	L"  --govern [MS] [--watchdog]\n"
+	L"                       move running apps whose rule has \",min=PRIORITY\" and/or\n"
+	L"                       \",max=PRIORITY\" one class down while they keep a CPU\n"
+	L"                       busy and back up when they go quiet, sampling every MS\n"
+	L"                       milliseconds (default 1000); runs until stopped;\n"
+	L"                       --watchdog runs the watchdog in the same loop (a separate\n"
+	L"                       --enforce --watchdog would see its demotions undone)\n"
+	L"Commands run in the order given.\n";
+
+static std::wstring TraceFile; // --trace; empty when not tracing
+
+// Write the trace so far to TraceFile and print the top steps by total time
+static void DumpTrace(size_t top, std::wostream& out, std::wostream& err) {
+	if (TraceFile.empty()) return;
+	std::vector<TraceEvent> events = CollectTrace();
+	std::ofstream file(std::filesystem::path(TraceFile), std::ios::binary | std::ios::trunc);
+	if (file) WriteChromeTrace(events, file);
+	if (!file.flush()) {
+		err << L"cannot write \"" << TraceFile << L"\"" << std::endl;
+		return;
+	}
+
+	std::vector<TraceStat> stats = SummarizeTrace(events);
+	out << L"Trace: " << events.size() << L" event(s) in \"" << TraceFile << L"\"" << std::endl;
+	for (size_t i = 0; i < stats.size() && i < top; ++i)
+		out << L"  " << FormatTraceStat(stats[i]) << std::endl;
+}
+
+// nullptr when a .reg export cannot be read
+static std::unique_ptr<PriorityStore> OpenStore(const std::wstring& file) {
+	if (!file.empty() && IsRegFile(file)) {
+		auto dump = std::make_unique<RegFileStore>(std::filesystem::path(file));
+		if (!dump->Load()) return nullptr;
+		return dump;
+	}
+	if (!file.empty())
+		return std::make_unique<FileStore>(std::filesystem::path(file));
+#ifdef _WIN32
+	return std::make_unique<RegistryStore>();
+#else
+	return std::make_unique<FileStore>("ifeo.txt"); // no registry here, use the local stand-in
+#endif
+}
+
+#ifdef _WIN32
+// The system applies everything else when an app starts; thread rules need applying to the
+// threads themselves, every watchSeconds when given
+static bool EnforceThreads(PriorityStore& store, unsigned watchSeconds, std::wostream& out) {
+	RuleTable rules;
+	while (true) {
+		rules.Build(store.LoadSnapshot());
+		auto start = std::chrono::steady_clock::now();
+		EnforceStats stats = EnforceThreadRules(rules);
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		out << L"Enforced thread rules on " << stats.scanned << L" thread(s): " << stats.matched << L" matched, "
+			<< stats.applied << L" changed, " << stats.failed << L" failed in " << elapsed.count() << L" us" << std::endl;
+		if (!watchSeconds) return stats.failed == 0;
+		std::this_thread::sleep_for(std::chrono::seconds(watchSeconds));
+	}
+}
+#endif
+
+#ifndef _WIN32
+static void PrintSweep(const RuleTable& rules, const EnforceStats& stats, long long micros, bool cgroups, std::wostream& out, std::wostream& err) {
+	out << L"Enforced " << rules.Size() << L" rule(s) on " << stats.scanned << L" process(es): "
+		<< stats.matched << L" matched, " << stats.applied << L" changed, " << stats.failed << L" failed";
+	if (stats.held) out << L", " << stats.held << L" held by the watchdog";
+	out << L" in " << micros << L" us" << std::endl;
+	if (stats.failed) {
+		err << L"some processes could not be changed (raising priority needs root or CAP_SYS_NICE"
+			<< (cgroups ? L"; without root only processes inside the delegated cgroup can be moved)" : L")") << std::endl;
+	}
+}
+
+// Per-process work of a sweep: cgroup placement, and skipping what the watchdog holds down
+static ProcessHook MakeHook(CgroupManager* cgroups, const StarvationWatchdog* watchdog) {
+	if (!cgroups && !watchdog) return nullptr;
+	return [cgroups, watchdog](int pid, const RuleTable::Rule& rule) {
+		if (watchdog && watchdog->Holds(pid)) return EnforceResult::Held; // leave it alone until restored
+		return cgroups ? cgroups->Place(pid, rule) : EnforceResult::Unchanged;
+	};
+}
+
+static void PrintWatchdog(const std::vector<WatchdogEvent>& events, std::wostream& out, std::wostream& err) {
+	for (const WatchdogEvent& event : events) {
+		std::wostream& stream = event.kind == WatchdogEvent::Failed ? err : out;
+		stream << L"Watchdog: ";
+		if (event.kind == WatchdogEvent::Restored) {
+			stream << L"restored " << event.pid << L" " << Utf8ToWide(event.name) << L" to "
+				<< (PriorityRank(event.to) ? ConvertHexToName(event.to) : L"its thread rules") << std::endl;
+			continue;
+		}
+		stream << (event.kind == WatchdogEvent::Failed ? L"cannot demote " : L"demoted ") << event.pid << L" "
+			<< Utf8ToWide(event.name) << L" from " << ConvertHexToName(event.from) << L" to " << ConvertHexToName(event.to);
+		if (event.delay > 0) {
+			stream << L": " << (event.cpu >= 0 ? L"CPU " + std::to_wstring(event.cpu) : std::wstring(L"CPUs"))
+				<< L" starved " << (int)(event.delay * 100 + 0.5) << L"%, it used " << (int)(event.used * 100 + 0.5) << L"%";
+		}
+		stream << std::endl;
+	}
+}
+
+static EnforceStats Sweep(PriorityStore& store, RuleTable& rules, ProcSweeper& sweeper, CgroupManager* cgroups,
+	const StarvationWatchdog* watchdog, std::wostream& out, std::wostream& err) {
+	rules.Build(store.LoadSnapshot());
+	auto start = std::chrono::steady_clock::now();
+	if (cgroups) {
+		std::string error;
+		cgroups->Sync(rules, error);
+		if (!error.empty())
+			err << Utf8ToWide(error) << std::endl;
+	}
+	EnforceStats stats = sweeper.Sweep(rules, MakeHook(cgroups, watchdog));
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+	PrintSweep(rules, stats, elapsed.count(), cgroups != nullptr, out, err);
+	return stats;
+}
+
+// Check the watchdog can read its numbers and raise ourselves above the Realtime class it
+// watches (SCHED_RR 1), or a spinning offender could starve it too
+static bool StartWatchdog(StarvationWatchdog& watchdog, std::wostream& out, std::wostream& err) {
+	if (!watchdog.Available()) {
+		err << L"cannot use the watchdog: neither /proc/schedstat nor /proc/pressure/cpu can be read" << std::endl;
+		return false;
+	}
+	out << L"Watchdog on, " << (watchdog.PerCpu() ? L"per-CPU run-queue delay from /proc/schedstat" : L"CPU pressure from /proc/pressure/cpu (no /proc/schedstat)") << std::endl;
+	sched_param param{};
+	param.sched_priority = 2;
+	if (sched_setscheduler(0, SCHED_RR, &param) != 0)
+		err << L"cannot raise the watchdog to SCHED_RR (needs root or CAP_SYS_NICE); a Realtime hog may delay it" << std::endl;
+	return true;
+}
+
+// Sweep once; with watchSeconds, keep applying rules to processes as they start and
+// resweep (rereading the rules) every watchSeconds. The watchdog, when given, is sampled
+// in between.
+static bool Enforce(PriorityStore& store, unsigned watchSeconds, CgroupManager* cgroups, StarvationWatchdog* watchdog,
+	std::wostream& out, std::wostream& err) {
+	RuleTable rules;
+	ProcSweeper sweeper;
+	EnforceStats stats = Sweep(store, rules, sweeper, cgroups, watchdog, out, err);
+	if (!watchSeconds) return stats.failed == 0;
+
+	ProcessEvents events;
+	ProcessPoller poller;
+	if (events.Open()) {
+		out << L"Following process starts through the proc connector" << std::endl;
+	}
+	else {
+		out << L"Proc connector unavailable (needs root or CAP_NET_ADMIN), polling /proc instead" << std::endl;
+		poller.Poll([](const ProcEvent&) {}); // remember what already runs
+	}
+
+	ProcessHook hook = MakeHook(cgroups, watchdog);
+	auto sampleEvery = std::chrono::milliseconds(watchdog ? watchdog->Config().intervalMs : 0);
+	auto nextSample = std::chrono::steady_clock::now() + sampleEvery;
+
+	LatencyStats latency;
+	size_t failed = 0;
+	auto onEvent = [&](const ProcEvent& event) {
+		if (watchdog && watchdog->Holds(event.pid)) return; // its threads stay demoted
+		EnforceResult result;
+		if (event.kind == ProcEvent::Exec || (event.kind == ProcEvent::Comm && event.pid == event.tid))
+			result = EnforcePid(rules, event.pid, hook); // a renamed main thread renames the process
+		else if (event.pid != event.tid)
+			result = EnforceThread(rules, event.pid, event.tid); // new or renamed thread; a new process inherits
+		else
+			return;
+
+		if (event.kind == ProcEvent::Comm) {
+			if (result == EnforceResult::Failed) ++failed;
+		}
+		else if (result == EnforceResult::Applied || result == EnforceResult::Unchanged) {
+			uint64_t now = MonotonicNs();
+			latency.Add(now > event.timestampNs ? now - event.timestampNs : 0);
+		}
+		else if (result == EnforceResult::Failed) {
+			++failed;
+		}
+	};
+
+	const int POLL_MS = 100;
+	while (true) {
+		auto next = std::chrono::steady_clock::now() + std::chrono::seconds(watchSeconds);
+		for (auto now = std::chrono::steady_clock::now(); now < next; now = std::chrono::steady_clock::now()) {
+			if (watchdog && now >= nextSample) {
+				PrintWatchdog(watchdog->Sample(rules), out, err);
+				nextSample = now + sampleEvery;
+			}
+			if (!events.IsOpen()) {
+				poller.Poll(onEvent);
+				std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MS));
+				continue;
+			}
+
+			auto until = watchdog && nextSample < next ? nextSample : next;
+			int remaining = (int)std::chrono::duration_cast<std::chrono::milliseconds>(until - now).count();
+			bool overrun = false;
+			if (!events.Poll(remaining + 1, onEvent, overrun)) {
+				err << L"proc connector failed, polling /proc instead" << std::endl;
+				events.Close();
+				poller.Poll([](const ProcEvent&) {});
+			}
+			if (overrun) {
+				err << L"missed process events, sweeping to catch up" << std::endl;
+				sweeper.Sweep(rules, hook);
+			}
+		}
+
+		if (latency.Count()) {
+			out << L"Applied on " << latency.Count() << L" start(s), exec to applied: p50 "
+				<< latency.Percentile(0.5) / 1000 << L" us, p99 " << latency.Percentile(0.99) / 1000
+				<< L" us, max " << latency.Max() / 1000 << L" us, " << failed << L" failed" << std::endl;
+			latency.Clear();
+			failed = 0;
+		}
+		Sweep(store, rules, sweeper, cgroups, watchdog, out, err);
+		DumpTrace(3, out, err); // --watch only ends with a signal, so keep the file current
+	}
+}
+#endif
+
+// Sample every intervalMs until stopped, rereading the rules every few seconds. The
+// watchdog, when given, is sampled in the same loop and the governor leaves what it holds.
+static bool Govern(PriorityStore& store, unsigned intervalMs, StarvationWatchdog* watchdog, std::wostream& out, std::wostream& err) {
+	GovernorConfig config;
+	config.intervalMs = intervalMs;
+	PriorityGovernor governor(config);
+	RuleTable rules;
+	const auto REREAD = std::chrono::seconds(5);
+	auto reread = std::chrono::steady_clock::now();
+	auto nextGovern = reread, nextSample = reread;
+	size_t governed = (size_t)-1;
+	std::function<bool(int)> held;
+#ifndef _WIN32
+	auto sampleEvery = std::chrono::milliseconds(watchdog ? watchdog->Config().intervalMs : 0);
+	if (watchdog) held = [watchdog](int pid) { return watchdog->Holds(pid); };
+#else
+	(void)watchdog;
+#endif
+
+	while (true) {
+		auto now = std::chrono::steady_clock::now();
+		if (now >= reread) {
+			rules.Build(store.LoadSnapshot());
+			size_t count = std::count_if(rules.Rules().begin(), rules.Rules().end(), [](const RuleTable::Rule& rule) { return rule.Governed(); });
+			if (count != governed)
+				out << L"Governing " << count << L" rule(s), sampling every " << intervalMs << L" ms" << std::endl;
+			governed = count;
+			reread = now + REREAD;
+			DumpTrace(3, out, err); // ends only with a signal, so keep the file current
+		}
+
+#ifndef _WIN32
+		if (watchdog && now >= nextSample) {
+			PrintWatchdog(watchdog->Sample(rules), out, err);
+			nextSample = now + sampleEvery;
+		}
+#endif
+		if (now >= nextGovern) {
+			for (const GovernorStep& step : governor.Sample(rules, held)) {
+				std::wostream& stream = step.applied ? out : err;
+				if (!step.applied) stream << L"cannot move ";
+				stream << step.pid << L" " << Utf8ToWide(step.name) << L": " << ConvertHexToName(step.from) << L" -> "
+					<< ConvertHexToName(step.to) << L" at " << (int)(step.cpus * 100 + 0.5) << L"% CPU" << std::endl;
+			}
+			nextGovern = now + std::chrono::milliseconds(intervalMs);
+		}
+		std::this_thread::sleep_until(watchdog && nextSample < nextGovern ? nextSample : nextGovern);
+	}
+}
+
+static bool ApplyRules(PriorityStore& store, std::istream& in, std::wostream& out, std::wostream& err) {
+	auto start = std::chrono::steady_clock::now();
+	ImportResult result = ImportRules(store, in, [&](size_t lineNo, const std::wstring& line) {
+		err << L"line " << lineNo << L": cannot apply \"" << line << L"\"\n";
+	});
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	out << L"Applied " << result.applied << L" rule(s), " << result.failed << L" failed in " << elapsed.count() << L" ms\n";
+	return result.failed == 0;
+}
+
+// A saved profile by name, or any rule file by path
+static bool SwitchProfileCommand(PriorityStore& store, const std::wstring& profile, std::wostream& out, std::wostream& err) {
+	std::filesystem::path file = IsValidProfileName(profile) ? ProfilePath(DefaultProfileDirectory(), profile) : std::filesystem::path(profile);
+	std::ifstream in(file, std::ios::binary);
+	if (!in) {
+		err << L"no profile \"" << profile << L"\" (looked for \"" << file.wstring() << L"\")\n";
+		return false;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	ProfileSwitch result = SwitchProfile(store, in, [&](size_t lineNo, const std::wstring& text) {
+		err << L"line " << lineNo << L": cannot parse \"" << text << L"\"\n";
+	});
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+	if (result.failed) {
+		err << L"profile \"" << profile << L"\" not applied: " << result.failed << L" bad line(s)\n";
+		return false;
+	}
+	if (!result.committed) {
+		err << L"cannot switch to \"" << profile << L"\": " << result.Writes() << L" app(s) could not be written, nothing was changed\n";
+		return false;
+	}
+	out << L"Switched to \"" << profile << L"\": " << result.added << L" added, " << result.changed << L" changed, "
+		<< result.released << L" released, " << result.unchanged << L" unchanged in " << elapsed.count() << L" us\n";
+	return true;
+}
+
+int RunCommandLine(const std::vector<std::wstring>& args, std::wostream& out, std::wostream& err) {
+	std::wstring storeFile;
+	for (size_t i = 0; i + 1 < args.size(); ++i) {
+		if (args[i] == L"--store") storeFile = args[i + 1];
+		if (args[i] == L"--trace") TraceFile = args[i + 1];
+	}
+	EnableTracing(!TraceFile.empty());
+
+	std::unique_ptr<PriorityStore> store = OpenStore(storeFile);
+	if (!store) {
+		err << L"cannot read \"" << storeFile << L"\" as a registry export\n";
+		return 2;
+	}
+	bool ok = true;
+
+	// consecutive --set and --remove commands go to the store as one batch
+	WriteBatch pending;
+	auto flush = [&]() {
+		if (!pending.Empty() && !store->Commit(pending)) {
+			err << L"cannot apply " << pending.Size() << L" pending change(s)\n";
+			ok = false;
+		}
+		pending.Clear();
+	};
+
+	for (size_t i = 0; i < args.size(); ++i) {
+		const std::wstring& command = args[i];
+		const bool hasValue = i + 1 < args.size();
+		if (command != L"--set" && command != L"--remove") flush();
+
+		if (command == L"--help" || command == L"-h" || command == L"/?") {
+			out << USAGE;
+		}
+		else if ((command == L"--store" || command == L"--trace") && hasValue) {
+			++i; // handled above
+		}
+		else if (command == L"--list") {
+			bool all = hasValue && args[i + 1] == L"--all";
+			if (all) ++i;
+			store->ForEachApp([&](const AppRecord& app) {
+				if (all || app.managed)
+					out << FormatEntryLine(app) << L'\n';
+				return true;
+			});
+		}
+		else if (command == L"--get" && hasValue) {
+			const std::wstring& name = args[++i];
+			bool found = false;
+			store->ForEachApp([&](const AppRecord& app) {
+				if (_wcsicmp(app.name.c_str(), name.c_str()) != 0) return true;
+				out << FormatEntryLine(app) << L'\n';
+				found = true;
+				return false;
+			});
+			if (!found) {
+				err << L"\"" << name << L"\" not found\n";
+				ok = false;
+			}
+		}
+		else if (command == L"--set" && hasValue) {
+			AppRecord rule;
+			if (!ParseEntryLine(args[++i], rule) || !ApplyRule(pending, rule)) {
+				err << L"cannot apply \"" << args[i] << L"\"\n";
+				ok = false;
+			}
+		}
+		else if ((command == L"--apply" || command == L"--import") && hasValue) {
+			const std::wstring& file = args[++i];
+			if (file == L"-") {
+				ok = ApplyRules(*store, std::cin, out, err) && ok;
+			}
+			else {
+				std::ifstream in(std::filesystem::path(file), std::ios::binary);
+				if (!in) {
+					err << L"cannot open \"" << file << L"\"\n";
+					ok = false;
+					continue;
+				}
+				ok = ApplyRules(*store, in, out, err) && ok;
+			}
+		}
+		else if (command == L"--export" && hasValue) {
+			const std::wstring& file = args[++i];
+			bool all = i + 1 < args.size() && args[i + 1] == L"--all";
+			if (all) ++i;
+
+			std::ofstream outFile(std::filesystem::path(file), std::ios::binary | std::ios::trunc);
+			size_t written = outFile ? ExportRules(*store, outFile, all) : 0;
+			if (!outFile.flush()) {
+				err << L"cannot write \"" << file << L"\"\n";
+				ok = false;
+				continue;
+			}
+			out << L"Exported " << written << L" rule(s)\n";
+		}
+		else if (command == L"--profiles") {
+			for (const auto& name : ListProfiles(DefaultProfileDirectory()))
+				out << name << L'\n';
+		}
+		else if (command == L"--save-profile" && hasValue) {
+			const std::wstring& name = args[++i];
+			if (!IsValidProfileName(name)) {
+				err << L"\"" << name << L"\" is not a valid profile name\n";
+				ok = false;
+				continue;
+			}
+			std::filesystem::path file = ProfilePath(DefaultProfileDirectory(), name);
+			if (!SaveProfile(*store, file)) {
+				err << L"cannot write \"" << file.wstring() << L"\"\n";
+				ok = false;
+				continue;
+			}
+			out << L"Saved profile \"" << name << L"\" to \"" << file.wstring() << L"\"\n";
+		}
+		else if (command == L"--profile" && hasValue) {
+			ok = SwitchProfileCommand(*store, args[++i], out, err) && ok;
+		}
+		else if (command == L"--enforce") {
+			unsigned watchSeconds = 0;
+			bool useCgroups = false, useWatchdog = false;
+			std::wstring cgroupRoot;
+			while (i + 1 < args.size()) {
+				if (i + 2 < args.size() && args[i + 1] == L"--watch") {
+					watchSeconds = (unsigned)wcstoul(args[i + 2].c_str(), nullptr, 10);
+					if (!watchSeconds) watchSeconds = 1;
+					i += 2;
+				}
+				else if (args[i + 1] == L"--watchdog") {
+					useWatchdog = true;
+					++i;
+				}
+				else if (args[i + 1] == L"--cgroup") {
+					useCgroups = true;
+					++i;
+					if (i + 1 < args.size() && args[i + 1].compare(0, 2, L"--") != 0)
+						cgroupRoot = args[++i];
+				}
+				else {
+					break;
+				}
+			}
+#ifdef _WIN32
+			if (useCgroups || useWatchdog) {
+				err << L"--cgroup and --watchdog are Linux only\n";
+				ok = false;
+				continue;
+			}
+			ok = EnforceThreads(*store, watchSeconds, out) && ok;
+#else
+			CgroupManager cgroups;
+			if (useCgroups) {
+				std::string error;
+				if (!cgroups.Open(WideToUtf8(cgroupRoot), error)) {
+					err << L"cannot use cgroups: " << Utf8ToWide(error) << std::endl;
+					ok = false;
+					continue;
+				}
+				out << L"Placing apps in cgroups under " << Utf8ToWide(cgroups.Root()) << std::endl;
+			}
+			StarvationWatchdog watchdog;
+			if (useWatchdog) {
+				if (!watchSeconds) {
+					err << L"--watchdog needs --watch: it samples while enforcement keeps running\n";
+					ok = false;
+					continue;
+				}
+				if (!StartWatchdog(watchdog, out, err)) {
+					ok = false;
+					continue;
+				}
+			}
+			ok = Enforce(*store, watchSeconds, useCgroups ? &cgroups : nullptr, useWatchdog ? &watchdog : nullptr, out, err) && ok;
+#endif
+		}
+		else if (command == L"--govern") {
+			unsigned intervalMs = 1000;
+			if (hasValue && iswdigit(args[i + 1][0]))
+				intervalMs = (unsigned)wcstoul(args[++i].c_str(), nullptr, 10);
+			bool useWatchdog = i + 1 < args.size() && args[i + 1] == L"--watchdog";
+			if (useWatchdog) ++i;
+#ifdef _WIN32
+			if (useWatchdog) {
+				err << L"--watchdog is Linux only\n";
+				ok = false;
+				continue;
+			}
+			ok = Govern(*store, intervalMs < 10 ? 10 : intervalMs, nullptr, out, err) && ok;
+#else
+			StarvationWatchdog watchdog;
+			if (useWatchdog && !StartWatchdog(watchdog, out, err)) {
+				ok = false;
+				continue;
+			}
+			ok = Govern(*store, intervalMs < 10 ? 10 : intervalMs, useWatchdog ? &watchdog : nullptr, out, err) && ok;
+#endif
+		}
+		else if (command == L"--remove" && hasValue) {
+			pending.RemoveApp(args[++i]);
+		}
+		else {
+			err << L"unknown or incomplete command \"" << command << L"\"\n" << USAGE;
+			return 2;
+		}
+	}
+
+	flush(); // each batch is journaled and synced as it commits; the store compacts on close
+	DumpTrace(10, out, err);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "store.h"
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Headless mode: everything the dialogs do, driven by arguments instead of windows.
+// args excludes the program name. Returns the process exit code.
+int RunCommandLine(const std::vector<std::wstring>& args, std::wostream& out, std::wostream& err);
@@ -0,0 +1,17 @@
+// Entry point for the portable command-line build (no GUI outside Windows).
+// On Windows the same commands go through wWinMain in main.cpp.
+#ifndef _WIN32
+#include "cli.h"
+#include <clocale>
+#include <iostream>
+
+int main(int argc, char** argv) {
+	setlocale(LC_ALL, "");
+
+	std::vector<std::wstring> args;
+	for (int i = 1; i < argc; ++i)
+		args.push_back(Utf8ToWide(argv[i]));
+
+	return RunCommandLine(args, std::wcout, std::wcerr);
+}
+#endif
@@ -0,0 +1,511 @@
+#include "enforce.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <tlhelp32.h>
+#include <unordered_map>
+#else
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+bool MapPriorityClass(DWORD priority, SchedClass& sched) {
+	sched = SchedClass{};
+	switch (priority)
+	{
+	case 1: sched.policy = SchedPolicy::Idle; sched.nice = 19; return true;  // Idle
+	case 5: sched.nice = 10; return true;                                    // Below Normal
+	case 2: sched.nice = 0; return true;                                     // Normal
+	case 6: sched.nice = -5; return true;                                    // Above Normal
+	case 3: sched.nice = -10; return true;                                   // High
+	case 4: sched.policy = SchedPolicy::RoundRobin; sched.rtPriority = 1; return true; // Realtime
+	default: return false;
+	}
+}
+
+bool MapIoPriority(DWORD io, int& ioprio) {
+	const int CLASS_SHIFT = 13, BEST_EFFORT = 2, IDLE = 3;
+	switch (io)
+	{
+	case 0: ioprio = IDLE << CLASS_SHIFT; return true;             // Very Low
+	case 1: ioprio = (BEST_EFFORT << CLASS_SHIFT) | 7; return true; // Low
+	case 2: ioprio = (BEST_EFFORT << CLASS_SHIFT) | 4; return true; // Normal
+	case 3: ioprio = (BEST_EFFORT << CLASS_SHIFT) | 0; return true; // High
+	default: return false;
+	}
+}
+
+static char LowerAscii(char c) {
+	return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+}
+
+static bool IsPathKey(const std::string& key) {
+	return key.find('/') != std::string::npos;
+}
+
+#ifndef _WIN32
+// The kernel cuts comm to COMM_LEN bytes, so a longer name is only ever seen as its first
+// COMM_LEN. A pattern whose literal start runs past the cut keeps that much plus a '*', which
+// matches the cut name alone and still loses to an exact name; one with a wildcard before the
+// cut is left as it is.
+static void CutToComm(std::string& key) {
+	if (key.size() <= COMM_LEN) return;
+	size_t wildcard = key.find_first_of("*?");
+	if (wildcard == std::string::npos) {
+		key.resize(COMM_LEN);
+	}
+	else if (wildcard >= COMM_LEN) {
+		key.resize(COMM_LEN);
+		key += '*';
+	}
+}
+#endif
+
+// A thread rule's name as threadNames keys it: lower-case, cut like comm
+static std::string ThreadKey(const std::wstring& threadName) {
+	std::string key = WideToUtf8(threadName);
+	std::transform(key.begin(), key.end(), key.begin(), LowerAscii);
+#ifndef _WIN32
+	CutToComm(key);
+#endif
+	return key;
+}
+
+static std::string RuleKey(const std::wstring& appName) {
+	std::string key = WideToUtf8(appName);
+	if (IsPathKey(key)) { // Linux paths are case-sensitive: kept as written
+		if (key.back() == '/') key += '*'; // a directory: everything below it
+		return key;
+	}
+	std::transform(key.begin(), key.end(), key.begin(), LowerAscii);
+	if (key.size() > 4 && key.compare(key.size() - 4, 4, ".exe") == 0)
+		key.resize(key.size() - 4);
+#ifndef _WIN32
+	CutToComm(key); // Windows names are whole: cutting them would let two long names collide
+#endif
+	return key;
+}
+
+#ifndef _WIN32
+// A cpulist-format file from sysfs; empty when missing
+static std::vector<unsigned> ReadSysList(const char* path) {
+	std::vector<unsigned> values;
+	char list[4096];
+	FILE* file = fopen(path, "r");
+	if (!file) return values;
+	if (fgets(list, sizeof(list), file)) {
+		std::string text(list);
+		while (!text.empty() && (text.back() == '\n' || text.back() == ' ')) text.pop_back();
+		if (!text.empty()) ParseCpuList(Utf8ToWide(text), values);
+	}
+	fclose(file);
+	return values;
+}
+
+// Empty for a node without CPUs or that does not exist
+static std::vector<unsigned> NodeCpus(int node) {
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+	return ReadSysList(path);
+}
+#endif
+
+void RuleTable::Build(const std::vector<AppRecord>& apps) {
+	TRACE_SCOPE("enforce", "RuleTable::Build");
+	rules.clear();
+	for (const auto& app : apps) {
+		if (!app.managed) continue;
+
+		Rule rule;
+		rule.hasSched = app.hasPriority && MapPriorityClass(app.priority, rule.sched);
+		rule.priority = app.priority;
+		rule.minPriority = rule.maxPriority = app.priority;
+		if (rule.hasSched) {
+			// a missing bound, or one on the wrong side of the priority, is the priority itself
+			int rank = PriorityRank(app.priority);
+			if (PriorityRank(app.minPriority) && PriorityRank(app.minPriority) < rank) rule.minPriority = app.minPriority;
+			if (PriorityRank(app.maxPriority) > rank) rule.maxPriority = app.maxPriority;
+			if (rule.Governed()) rule.hasSched = false;
+		}
+		if (!app.hasIoPriority || !MapIoPriority(app.ioPriority, rule.ioprio))
+			rule.ioprio = -1;
+		rule.numaNode = app.numaNode < (int)MAX_CPUS ? app.numaNode : -1;
+		if (!app.cpuSet.empty())
+			ParseCpuList(app.cpuSet, rule.cpus);
+#ifndef _WIN32
+		else if (rule.numaNode >= 0)
+			rule.cpus = NodeCpus(rule.numaNode);
+#endif
+		rule.cpuWeight = app.cpuWeight;
+		rule.cpuQuota = app.cpuQuota;
+
+		std::vector<ThreadRule> threadRules;
+		if (!app.threadRules.empty() && ParseThreadRules(app.threadRules, threadRules)) {
+			for (const auto& threadRule : threadRules) {
+				Rule::ThreadClass thread;
+				thread.priority = threadRule.priority;
+				if (!MapPriorityClass(threadRule.priority, thread.sched)) continue;
+				rule.threadNames.Add(ThreadKey(threadRule.name), (uint32_t)rule.threadClasses.size());
+				rule.threadClasses.push_back(thread);
+			}
+			rule.threadNames.Compile();
+		}
+
+		if (!rule.hasSched && !rule.Governed() && !rule.HasThreadRules() && rule.ioprio < 0 && rule.cpus.empty() &&
+			rule.numaNode < 0 && !rule.cpuWeight && !rule.cpuQuota)
+			continue;
+
+		rule.key = RuleKey(app.name);
+		if (!rule.key.empty())
+			rules.push_back(std::move(rule));
+	}
+
+	std::stable_sort(rules.begin(), rules.end(), [](const Rule& a, const Rule& b) { return a.key < b.key; });
+	rules.erase(std::unique(rules.begin(), rules.end(), [](const Rule& a, const Rule& b) { return a.key == b.key; }), rules.end());
+
+	names.Clear();
+	paths.Clear();
+	for (uint32_t index = 0; index < rules.size(); ++index)
+		(IsPathKey(rules[index].key) ? paths : names).Add(rules[index].key, index);
+	names.Compile();
+	paths.Compile();
+}
+
+const RuleTable::Rule::ThreadClass* RuleTable::Rule::FindThread(std::string_view threadName) const {
+	if (threadClasses.empty() || threadName.empty()) return nullptr;
+#ifndef _WIN32
+	threadName = threadName.substr(0, COMM_LEN);
+#endif
+	uint32_t index = threadNames.Match(threadName);
+	return index == NameMatcher::NONE ? nullptr : &threadClasses[index];
+}
+
+const SchedClass* RuleTable::Rule::ThreadSched(std::string_view threadName) const {
+	if (const ThreadClass* thread = FindThread(threadName)) return &thread->sched;
+	return hasSched ? &sched : nullptr;
+}
+
+const RuleTable::Rule* RuleTable::Find(std::string_view comm) const {
+#ifndef _WIN32
+	comm = comm.substr(0, COMM_LEN);
+#endif
+	uint32_t index = names.Match(comm);
+	return index == NameMatcher::NONE ? nullptr : &rules[index];
+}
+
+const RuleTable::Rule* RuleTable::Find(std::string_view comm, std::string_view exePath) const {
+	if (!exePath.empty() && !paths.Empty()) {
+		uint32_t index = paths.Match(exePath);
+		if (index != NameMatcher::NONE) return &rules[index];
+	}
+	return Find(comm);
+}
+
+#ifndef _WIN32
+EnforceResult ApplySchedClass(int tid, const SchedClass& sched) {
+	int current = sched_getscheduler(tid);
+	if (current < 0)
+		return errno == ESRCH ? EnforceResult::Gone : EnforceResult::Failed;
+	current &= ~SCHED_RESET_ON_FORK;
+
+	bool changed = false;
+	if (sched.policy == SchedPolicy::RoundRobin) {
+		sched_param param{};
+		if (current == SCHED_RR && sched_getparam(tid, &param) == 0 && param.sched_priority == sched.rtPriority)
+			return EnforceResult::Unchanged;
+
+		param.sched_priority = sched.rtPriority;
+		if (sched_setscheduler(tid, SCHED_RR, &param) != 0)
+			return errno == ESRCH ? EnforceResult::Gone : EnforceResult::Failed;
+		return EnforceResult::Applied;
+	}
+
+	const int policy = sched.policy == SchedPolicy::Idle ? SCHED_IDLE : SCHED_OTHER;
+	if (current != policy) {
+		sched_param param{};
+		if (sched_setscheduler(tid, policy, &param) != 0)
+			return errno == ESRCH ? EnforceResult::Gone : EnforceResult::Failed;
+		changed = true;
+	}
+
+	// getpriority returns the nice value itself, so -1 is only an error when errno says so
+	errno = 0;
+	int nice = getpriority(PRIO_PROCESS, (id_t)tid);
+	if (nice == -1 && errno != 0)
+		return errno == ESRCH ? EnforceResult::Gone : EnforceResult::Failed;
+	if (nice != sched.nice) {
+		if (setpriority(PRIO_PROCESS, (id_t)tid, sched.nice) != 0)
+			return errno == ESRCH ? EnforceResult::Gone : EnforceResult::Failed;
+		changed = true;
+	}
+	return changed ? EnforceResult::Applied : EnforceResult::Unchanged;
+}
+
+EnforceResult ApplyAffinity(int pid, int tid, const RuleTable::Rule& rule) {
+	if (rule.cpus.empty()) return EnforceResult::Unchanged;
+
+	// only CPUs that are online: the kernel drops the rest, and comparing against them
+	// would make every sweep look like a change
+	static const std::vector<unsigned> online = ReadSysList("/sys/devices/system/cpu/online");
+	cpu_set_t want, have;
+	CPU_ZERO(&want);
+	for (unsigned cpu : rule.cpus) {
+		if (cpu < CPU_SETSIZE && (online.empty() || std::binary_search(online.begin(), online.end(), cpu)))
+			CPU_SET(cpu, &want);
+	}
+	if (CPU_COUNT(&want) == 0)
+		return EnforceResult::Failed; // none of the rule's CPUs exist here
+
+	if (sched_getaffinity(tid, sizeof(have), &have) != 0)
+		return errno == ESRCH ? EnforceResult::Gone : EnforceResult::Failed;
+	if (CPU_EQUAL(&want, &have))
+		return EnforceResult::Unchanged;
+	if (sched_setaffinity(tid, sizeof(want), &want) != 0)
+		return errno == ESRCH ? EnforceResult::Gone : EnforceResult::Failed;
+
+	if (rule.numaNode >= 0 && tid == pid) {
+		// from every online node to the one in the rule. Only bits for nodes that exist:
+		// the kernel rejects masks reaching past the nodes it was built for.
+		static const std::vector<unsigned> nodes = ReadSysList("/sys/devices/system/node/online");
+		constexpr unsigned BITS = 8 * sizeof(unsigned long);
+		unsigned long from[MAX_CPUS / BITS] = {}, to[MAX_CPUS / BITS] = {};
+		unsigned long maxNode = (unsigned long)rule.numaNode;
+		for (unsigned node : nodes) {
+			from[node / BITS] |= 1ul << (node % BITS);
+			maxNode = std::max<unsigned long>(maxNode, node);
+		}
+		to[rule.numaNode / BITS] |= 1ul << (rule.numaNode % BITS);
+		if (syscall(SYS_migrate_pages, pid, maxNode + 2, from, to) < 0 && errno != ESRCH)
+			return EnforceResult::Failed;
+	}
+	return EnforceResult::Applied;
+}
+
+EnforceResult ApplyIoPriority(int tid, int ioprio) {
+	const int WHO_PROCESS = 1; // IOPRIO_WHO_PROCESS: a single thread, despite the name
+	if (ioprio < 0) return EnforceResult::Unchanged;
+
+	long current = syscall(SYS_ioprio_get, WHO_PROCESS, tid);
+	if (current < 0)
+		return errno == ESRCH ? EnforceResult::Gone : EnforceResult::Failed;
+	if (current == ioprio)
+		return EnforceResult::Unchanged;
+	if (syscall(SYS_ioprio_set, WHO_PROCESS, tid, ioprio) != 0)
+		return errno == ESRCH ? EnforceResult::Gone : EnforceResult::Failed;
+	return EnforceResult::Applied;
+}
+
+// Read /proc/<pid>/task/<tid>/comm without the trailing newline; 0 when the thread is gone
+static size_t ReadThreadComm(int pid, int tid, char (&comm)[COMM_LEN + 2]) {
+	char path[48];
+	snprintf(path, sizeof(path), "/proc/%d/task/%d/comm", pid, tid);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return 0;
+	ssize_t length = read(fd, comm, sizeof(comm));
+	close(fd);
+	if (length <= 0) return 0;
+	if (comm[length - 1] == '\n') --length;
+	return (size_t)length;
+}
+
+EnforceResult EnforceRule(int pid, int tid, const RuleTable::Rule& rule) {
+	char comm[COMM_LEN + 2];
+	size_t length = rule.HasThreadRules() ? ReadThreadComm(pid, tid, comm) : 0;
+	return EnforceRule(pid, tid, rule, std::string_view(comm, length));
+}
+
+EnforceResult EnforceRule(int pid, int tid, const RuleTable::Rule& rule, std::string_view threadName) {
+	const SchedClass* sched = rule.ThreadSched(threadName);
+	EnforceResult result = sched ? ApplySchedClass(tid, *sched) : EnforceResult::Unchanged;
+	if (result == EnforceResult::Gone) return result;
+	result = MergeResults(result, ApplyIoPriority(tid, rule.ioprio));
+	return MergeResults(result, ApplyAffinity(pid, tid, rule));
+}
+
+EnforceResult MergeResults(EnforceResult a, EnforceResult b) {
+	auto rank = [](EnforceResult result) {
+		switch (result)
+		{
+		case EnforceResult::Failed: return 3;
+		case EnforceResult::Applied: return 2;
+		case EnforceResult::Unchanged: return 1;
+		default: return 0;
+		}
+	};
+	return rank(a) >= rank(b) ? a : b;
+}
+
+// Read /proc/<pid>/comm without the trailing newline; 0 when the process is gone
+static size_t ReadComm(int pid, char (&comm)[COMM_LEN + 2]) {
+	char path[32];
+	snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return 0;
+	ssize_t length = read(fd, comm, sizeof(comm));
+	close(fd);
+	if (length <= 0) return 0;
+	if (comm[length - 1] == '\n') --length;
+	return (size_t)length;
+}
+
+// Target of /proc/<pid>/exe, empty when it cannot be read (kernel threads, gone, not ours)
+static std::string_view ReadExe(int pid, char (&exe)[PATH_MAX]) {
+	char path[32];
+	snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+	ssize_t length = readlink(path, exe, sizeof(exe));
+	return length > 0 && length < (ssize_t)sizeof(exe) ? std::string_view(exe, (size_t)length) : std::string_view();
+}
+
+// The rule for the process, looking at its executable only when path rules exist
+static const RuleTable::Rule* Match(const RuleTable& rules, int pid, std::string_view comm) {
+	char exe[PATH_MAX];
+	return rules.Find(comm, rules.HasPathRules() ? ReadExe(pid, exe) : std::string_view());
+}
+
+static bool IsPid(const char* name) {
+	if (*name == '\0') return false;
+	for (; *name; ++name) {
+		if (*name < '0' || *name > '9') return false;
+	}
+	return true;
+}
+
+EnforceResult EnforcePid(const RuleTable& rules, int pid, const ProcessHook& hook) {
+	TRACE_SCOPE("enforce", "EnforcePid");
+	char comm[COMM_LEN + 2];
+	size_t length = ReadComm(pid, comm);
+	if (length == 0) return EnforceResult::Gone;
+
+	const RuleTable::Rule* rule = Match(rules, pid, std::string_view(comm, length));
+	if (!rule) return EnforceResult::NoRule;
+
+	EnforceResult moved = hook ? hook(pid, *rule) : EnforceResult::Unchanged;
+	if (moved == EnforceResult::Gone || moved == EnforceResult::Held) return moved;
+
+	// the scheduler works per thread; threads started later inherit from the one that spawns them
+	char path[32];
+	snprintf(path, sizeof(path), "/proc/%d/task", pid);
+	DIR* tasks = opendir(path);
+	if (!tasks) return EnforceResult::Gone;
+
+	EnforceResult result = EnforceResult::Gone; // until a thread is still there
+	while (dirent* entry = readdir(tasks)) {
+		if (IsPid(entry->d_name))
+			result = MergeResults(result, EnforceRule(pid, atoi(entry->d_name), *rule));
+	}
+	closedir(tasks);
+	return result == EnforceResult::Gone ? result : MergeResults(result, moved);
+}
+
+const RuleTable::Rule* MatchPid(const RuleTable& rules, int pid, std::string* name) {
+	char comm[COMM_LEN + 2];
+	size_t length = ReadComm(pid, comm);
+	if (length == 0) return nullptr;
+	if (name) name->assign(comm, length);
+	return Match(rules, pid, std::string_view(comm, length));
+}
+
+EnforceResult ApplySchedClassToPid(int pid, const SchedClass& sched, const RuleTable::Rule* named) {
+	char path[32];
+	snprintf(path, sizeof(path), "/proc/%d/task", pid);
+	DIR* tasks = opendir(path);
+	if (!tasks) return EnforceResult::Gone;
+
+	EnforceResult result = EnforceResult::Gone;
+	while (dirent* entry = readdir(tasks)) {
+		if (!IsPid(entry->d_name)) continue;
+		int tid = atoi(entry->d_name);
+		const RuleTable::Rule::ThreadClass* thread = nullptr;
+		if (named && named->HasThreadRules()) {
+			char comm[COMM_LEN + 2];
+			thread = named->FindThread(std::string_view(comm, ReadThreadComm(pid, tid, comm)));
+		}
+		result = MergeResults(result, ApplySchedClass(tid, thread ? thread->sched : sched));
+	}
+	closedir(tasks);
+	return result;
+}
+
+EnforceResult EnforceThread(const RuleTable& rules, int pid, int tid) {
+	char comm[COMM_LEN + 2];
+	size_t length = ReadComm(pid, comm);
+	if (length == 0) return EnforceResult::Gone;
+
+	const RuleTable::Rule* rule = Match(rules, pid, std::string_view(comm, length));
+	return rule ? EnforceRule(pid, tid, *rule) : EnforceResult::NoRule;
+}
+#endif
+
+#ifdef _WIN32
+static int ThreadPriorityFor(DWORD priority) {
+	switch (priority)
+	{
+	case 1: return THREAD_PRIORITY_IDLE;
+	case 5: return THREAD_PRIORITY_BELOW_NORMAL;
+	case 6: return THREAD_PRIORITY_ABOVE_NORMAL;
+	case 3: return THREAD_PRIORITY_HIGHEST;
+	case 4: return THREAD_PRIORITY_TIME_CRITICAL;
+	default: return THREAD_PRIORITY_NORMAL;
+	}
+}
+
+EnforceStats EnforceThreadRules(const RuleTable& rules) {
+	TRACE_SCOPE("enforce", "EnforceThreadRules");
+	EnforceStats stats;
+	typedef HRESULT(WINAPI* GetThreadDescriptionFn)(HANDLE, PWSTR*);
+	static const auto getDescription = (GetThreadDescriptionFn)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "GetThreadDescription");
+	if (!getDescription) return stats; // older than Windows 10 1607: threads have no names
+
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS | TH32CS_SNAPTHREAD, 0);
+	if (snapshot == INVALID_HANDLE_VALUE) return stats;
+
+	std::unordered_map<DWORD, const RuleTable::Rule*> processes; // the ones with thread rules
+	PROCESSENTRY32W process{};
+	process.dwSize = sizeof(process);
+	for (BOOL more = Process32FirstW(snapshot, &process); more; more = Process32NextW(snapshot, &process)) {
+		std::string name = WideToUtf8(process.szExeFile);
+		std::string_view comm = name;
+		if (comm.size() > 4 && _stricmp(name.c_str() + name.size() - 4, ".exe") == 0)
+			comm.remove_suffix(4);
+		const RuleTable::Rule* rule = rules.Find(comm);
+		if (rule && rule->HasThreadRules()) processes.emplace(process.th32ProcessID, rule);
+	}
+
+	THREADENTRY32 entry{};
+	entry.dwSize = sizeof(entry);
+	for (BOOL more = Thread32First(snapshot, &entry); more; more = Thread32Next(snapshot, &entry)) {
+		auto found = processes.find(entry.th32OwnerProcessID);
+		if (found == processes.end()) continue;
+		++stats.scanned;
+
+		HANDLE thread = OpenThread(THREAD_QUERY_LIMITED_INFORMATION | THREAD_SET_LIMITED_INFORMATION, FALSE, entry.th32ThreadID);
+		if (!thread) continue;
+		PWSTR description = nullptr;
+		if (SUCCEEDED(getDescription(thread, &description)) && description) {
+			const RuleTable::Rule::ThreadClass* threadClass = found->second->FindThread(WideToUtf8(description));
+			if (threadClass) {
+				++stats.matched;
+				int want = ThreadPriorityFor(threadClass->priority);
+				if (GetThreadPriority(thread) != want) {
+					if (SetThreadPriority(thread, want)) ++stats.applied;
+					else ++stats.failed;
+				}
+			}
+			LocalFree(description);
+		}
+		CloseHandle(thread);
+	}
+	CloseHandle(snapshot);
+	return stats;
+}
+#endif
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "matcher.h"
+#include "store.h"
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Windows applies CpuPriorityClass itself when an app starts. Elsewhere nothing reads IFEO,
+// so the same rules are enforced on running processes through the scheduler.
+
+enum class SchedPolicy : unsigned char { Other, Idle, RoundRobin };
+
+struct SchedClass {
+	SchedPolicy policy = SchedPolicy::Other;
+	int nice = 0;        // SCHED_OTHER and SCHED_IDLE
+	int rtPriority = 0;  // SCHED_RR
+};
+
+// Idle         -> SCHED_IDLE, nice 19
+// Below Normal -> nice 10
+// Normal       -> nice 0
+// Above Normal -> nice -5
+// High         -> nice -10
+// Realtime     -> SCHED_RR, priority 1
+// False for values ConvertHexToName does not know.
+bool MapPriorityClass(DWORD priority, SchedClass& sched);
+
+// IoPriority as an ioprio_set value:
+// Very Low -> idle class
+// Low      -> best effort, level 7
+// Normal   -> best effort, level 4
+// High     -> best effort, level 0 (the realtime class is for the kernel's own use here too)
+// PagePriority has no per-process equivalent on Linux and is not enforced.
+bool MapIoPriority(DWORD io, int& ioprio);
+
+// Managed apps that have a priority, an I/O priority, a CPU set, a NUMA node, a cgroup CPU weight or quota or thread rules, keyed the way the kernel names a process:
+// lower-case, ".exe" dropped, cut to the 15 bytes /proc/<pid>/comm holds.
+// "make" and "make.exe" are the same rule; the first one in the store wins.
+// A name with '*' or '?' is a pattern ("cl*.exe", "*-worker"), matched against comm as
+// well; an exact name beats a pattern. A name with '/' matches the executable's path
+// instead ("/opt/game/bin/*", or "/opt/game/" for everything below it) and beats both.
+class RuleTable {
+public:
+	struct Rule {
+		std::string key;
+		DWORD priority = 0;
+		bool hasSched = false;        // false: leave policy and nice alone
+		SchedClass sched;
+		int ioprio = -1;              // -1: leave the I/O priority alone
+		std::vector<unsigned> cpus;   // affinity; empty: leave it alone. A node's CPUs when only the node is set
+		int numaNode = -1;            // memory is moved here when the affinity changes
+		DWORD cpuWeight = 0;          // explicit cgroup cpu.weight; 0: derived from the priority
+		DWORD cpuQuota = 0;           // cgroup cpu.max in percent of one CPU; 0: no limit
+		DWORD minPriority = 0;        // governor bounds, priority between them; equal when not governed
+		DWORD maxPriority = 0;
+
+		struct ThreadClass {
+			DWORD priority = 0;
+			SchedClass sched;
+		};
+		std::vector<ThreadClass> threadClasses; // the app's thread rules
+		NameMatcher threadNames;                // thread name to threadClasses index, keyed like comm
+
+		// The governor owns the class; enforcement leaves it alone (hasSched is false)
+		bool Governed() const { return minPriority != maxPriority; }
+		bool HasThreadRules() const { return !threadClasses.empty(); }
+
+		// What a thread of this app is given: its thread rule when its name has one (an exact
+		// name beats a pattern), else the app's class; nullptr leaves the thread alone
+		const ThreadClass* FindThread(std::string_view threadName) const;
+		const SchedClass* ThreadSched(std::string_view threadName) const;
+	};
+
+	void Build(const std::vector<AppRecord>& apps);
+	const Rule* Find(std::string_view comm) const; // comm as read, any case; no allocation once warm
+	const Rule* Find(std::string_view comm, std::string_view exePath) const;
+	bool HasPathRules() const { return !paths.Empty(); } // else exePath is never looked at
+
+	const std::vector<Rule>& Rules() const { return rules; }
+	size_t Size() const { return rules.size(); }
+	bool Empty() const { return rules.empty(); }
+
+private:
+	std::vector<Rule> rules;    // sorted by key
+	NameMatcher names;          // comm rules, ids index rules
+	NameMatcher paths{ false }; // executable path rules, case-sensitive
+};
+
+constexpr size_t COMM_LEN = 15; // TASK_COMM_LEN without the terminator
+
+#ifndef _WIN32
+enum class EnforceResult { Applied, Unchanged, NoRule, Gone, Held, Failed }; // Held: a hook kept it as it is
+
+// Put one thread into the class. Reads the current policy and nice value first, so a
+// thread that is already there costs two syscalls and no writes.
+EnforceResult ApplySchedClass(int tid, const SchedClass& sched);
+
+// Pin one thread to rule.cpus. When that changes the leader's (tid == pid) affinity and the
+// rule names a node, the process' memory is migrated to the node as well: set_mempolicy
+// only ever affects its caller, so for someone else's process binding means running on the
+// node's CPUs (new pages are local by default) and moving what is already allocated.
+EnforceResult ApplyAffinity(int pid, int tid, const RuleTable::Rule& rule);
+
+// Set the thread's I/O priority, checking it with ioprio_get first
+EnforceResult ApplyIoPriority(int tid, int ioprio);
+
+// Everything the rule says, for one thread. The first form reads the thread's name when the
+// rule has thread rules.
+EnforceResult EnforceRule(int pid, int tid, const RuleTable::Rule& rule);
+EnforceResult EnforceRule(int pid, int tid, const RuleTable::Rule& rule, std::string_view threadName);
+
+// The outcome to report for several threads: Failed, then Applied, then Unchanged, then Gone
+EnforceResult MergeResults(EnforceResult a, EnforceResult b);
+
+// Per-process work beyond the scheduler, run once for each process a rule matched before
+// its threads are handled (moving it into the app's cgroup). Returning Gone or Held skips
+// the threads.
+typedef std::function<EnforceResult(int pid, const RuleTable::Rule& rule)> ProcessHook;
+
+// Match the process by comm and apply the rule to every one of its threads
+EnforceResult EnforcePid(const RuleTable& rules, int pid, const ProcessHook& hook = nullptr);
+
+// Only thread tid of process pid, matched by the process' comm (a thread just created, or
+// one that renamed itself)
+EnforceResult EnforceThread(const RuleTable& rules, int pid, int tid);
+
+// The rule for a running process, nullptr when none matches or it is gone; name gets its comm
+const RuleTable::Rule* MatchPid(const RuleTable& rules, int pid, std::string* name = nullptr);
+
+// Every thread of the process into the class, whatever its rule says (governor, watchdog);
+// with named, threads one of its thread rules picks get that class instead
+EnforceResult ApplySchedClassToPid(int pid, const SchedClass& sched, const RuleTable::Rule* named = nullptr);
+
+#endif
+
+// Totals of one pass over /proc (see ProcSweeper), or over the threads on Windows
+struct EnforceStats {
+	size_t scanned = 0;
+	size_t matched = 0;  // held ones not included
+	size_t held = 0;     // matched, but left alone by the hook (the watchdog's demotions)
+	size_t applied = 0;
+	size_t failed = 0;
+};
+
+#ifdef _WIN32
+// The system applies CpuPriorityClass itself but knows nothing of thread rules. This gives
+// every running thread of a matched app whose description (SetThreadDescription, Windows 10
+// 1607 and later) a thread rule names the nearest thread priority:
+// Idle -> IDLE, Below Normal -> BELOW_NORMAL, Normal -> NORMAL, Above Normal -> ABOVE_NORMAL,
+// High -> HIGHEST, Realtime -> TIME_CRITICAL. Windows reports no thread starts or renames to
+// user mode without ETW, so threads named later are picked up by the next pass.
+EnforceStats EnforceThreadRules(const RuleTable& rules);
+#endif
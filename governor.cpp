@@ -0,0 +1,260 @@
+#include "governor.h"
+#include "trace.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <tlhelp32.h>
+#else
+#include <climits>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static uint64_t SteadyNs() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PriorityGovernor::Process& PriorityGovernor::Track(int pid, uint64_t startTime, uint64_t cpuNs, uint64_t nowNs,
+	const RuleTable::Rule& rule, bool& fresh) {
+	Process& process = processes[pid];
+	fresh = process.pass == 0 || process.startTime != startTime;
+	if (fresh) {
+		process = Process{};
+		process.startTime = startTime;
+		process.cpuNs = cpuNs;
+		process.sampledNs = nowNs;
+		process.priority = rule.priority;
+	}
+	process.pass = pass;
+	return process;
+}
+
+bool PriorityGovernor::Decide(Process& process, uint64_t cpuNs, uint64_t nowNs, const RuleTable::Rule& rule,
+	DWORD& next, double& cpus) {
+	uint64_t elapsed = nowNs - process.sampledNs;
+	cpus = elapsed && cpuNs >= process.cpuNs ? double(cpuNs - process.cpuNs) / double(elapsed) : 0;
+	process.cpuNs = cpuNs;
+	process.sampledNs = nowNs;
+
+	int rank = PriorityRank(process.priority);
+	int lowest = PriorityRank(rule.minPriority), highest = PriorityRank(rule.maxPriority);
+	if (rank < lowest || rank > highest) { // the rule changed under it
+		next = rank < lowest ? rule.minPriority : rule.maxPriority;
+		process.busy = process.idle = 0;
+		return true;
+	}
+
+	if (cpus >= config.busyCpus) {
+		++process.busy;
+		process.idle = 0;
+	}
+	else if (cpus <= config.idleCpus) {
+		++process.idle;
+		process.busy = 0;
+	}
+	else {
+		process.busy = process.idle = 0;
+	}
+
+	if (process.busy >= config.holdSamples && rank > lowest) --rank;
+	else if (process.idle >= config.holdSamples && rank < highest) ++rank;
+	else return false;
+
+	process.busy = process.idle = 0;
+	next = PriorityValues[rank];
+	return true;
+}
+
+void PriorityGovernor::Skip(Process& process, uint64_t cpuNs, uint64_t nowNs) {
+	process.cpuNs = cpuNs;
+	process.sampledNs = nowNs;
+	process.busy = process.idle = 0;
+}
+
+void PriorityGovernor::Forget() {
+	for (auto it = processes.begin(); it != processes.end();) {
+		if (it->second.pass != pass) it = processes.erase(it);
+		else ++it;
+	}
+}
+
+#ifdef _WIN32
+static DWORD PriorityClassFlag(DWORD priority) {
+	switch (priority)
+	{
+	case 1: return IDLE_PRIORITY_CLASS;
+	case 5: return BELOW_NORMAL_PRIORITY_CLASS;
+	case 6: return ABOVE_NORMAL_PRIORITY_CLASS;
+	case 3: return HIGH_PRIORITY_CLASS;
+	case 4: return REALTIME_PRIORITY_CLASS;
+	default: return NORMAL_PRIORITY_CLASS;
+	}
+}
+
+static uint64_t FileTimeValue(const FILETIME& time) {
+	return (uint64_t)time.dwHighDateTime << 32 | time.dwLowDateTime;
+}
+
+// GetPriorityClass first, so a process already in the class costs no write
+static bool ApplyPriorityClass(HANDLE process, DWORD priority) {
+	DWORD flag = PriorityClassFlag(priority);
+	return GetPriorityClass(process) == flag || SetPriorityClass(process, flag);
+}
+
+std::vector<GovernorStep> PriorityGovernor::Sample(const RuleTable& rules, const std::function<bool(int)>& held) {
+	TRACE_SCOPE("governor", "PriorityGovernor::Sample");
+	std::vector<GovernorStep> steps;
+	++pass;
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+	if (snapshot == INVALID_HANDLE_VALUE) return steps;
+
+	PROCESSENTRY32W entry{};
+	entry.dwSize = sizeof(entry);
+	for (BOOL more = Process32FirstW(snapshot, &entry); more; more = Process32NextW(snapshot, &entry)) {
+		std::string name = WideToUtf8(entry.szExeFile);
+		std::string_view comm = name;
+		if (comm.size() > 4 && _stricmp(name.c_str() + name.size() - 4, ".exe") == 0)
+			comm.remove_suffix(4); // rule keys drop it
+		const RuleTable::Rule* rule = rules.Find(comm);
+		if (!rule || !rule->Governed()) continue;
+
+		HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_SET_INFORMATION, FALSE, entry.th32ProcessID);
+		if (!process) continue;
+		FILETIME created, exited, kernel, user;
+		if (GetProcessTimes(process, &created, &exited, &kernel, &user)) {
+			uint64_t now = SteadyNs();
+			uint64_t cpuNs = (FileTimeValue(kernel) + FileTimeValue(user)) * 100;
+			int pid = (int)entry.th32ProcessID;
+			bool fresh;
+			Process& state = Track(pid, FileTimeValue(created), cpuNs, now, *rule, fresh);
+			DWORD next;
+			double cpus;
+			if (held && held(pid)) {
+				Skip(state, cpuNs, now);
+			}
+			else if (!fresh && Decide(state, cpuNs, now, *rule, next, cpus)) {
+				GovernorStep step;
+				step.pid = pid;
+				step.name = name;
+				step.from = state.priority;
+				step.to = next;
+				step.cpus = cpus;
+				step.applied = ApplyPriorityClass(process, next);
+				if (step.applied) state.priority = next;
+				steps.push_back(std::move(step));
+			}
+			else {
+				ApplyPriorityClass(process, state.priority);
+			}
+		}
+		CloseHandle(process);
+	}
+	CloseHandle(snapshot);
+	Forget();
+	return steps;
+}
+#else
+// utime + stime in ns and starttime from /proc/<pid>/stat, whose comm the name points into
+static bool ReadCpuTimes(int pid, char (&stat)[1024], std::string_view& comm, uint64_t& cpuNs, uint64_t& startTime) {
+	static const long ticks = sysconf(_SC_CLK_TCK);
+	char path[32];
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	ssize_t length = read(fd, stat, sizeof(stat) - 1);
+	close(fd);
+	if (length <= 0) return false;
+	stat[length] = '\0';
+
+	// "pid (comm) state ...": comm ends at the last ')'
+	char* begin = strchr(stat, '(');
+	char* end = strrchr(stat, ')');
+	if (!begin || !end || end < begin) return false;
+	comm = std::string_view(begin + 1, size_t(end - begin - 1));
+
+	// field 3 starts two characters after ')'; we want 14 (utime), 15 (stime) and 22 (starttime)
+	const char* field = end + 2;
+	uint64_t cpuTicks = 0;
+	for (int index = 3; index <= 22; ++index) {
+		if (index == 14 || index == 15) cpuTicks += strtoull(field, nullptr, 10);
+		else if (index == 22) {
+			startTime = strtoull(field, nullptr, 10);
+			cpuNs = cpuTicks * (1000000000ull / (uint64_t)(ticks > 0 ? ticks : 100));
+			return true;
+		}
+		field = strchr(field, ' ');
+		if (!field) return false;
+		++field;
+	}
+	return false;
+}
+
+// The class on every thread the rule's thread rules do not name: Applied, Unchanged, Gone
+// or Failed as for EnforcePid
+static EnforceResult ApplyToThreads(int pid, DWORD priority, const RuleTable::Rule& rule) {
+	SchedClass sched;
+	return MapPriorityClass(priority, sched) ? ApplySchedClassToPid(pid, sched, &rule) : EnforceResult::Failed;
+}
+
+std::vector<GovernorStep> PriorityGovernor::Sample(const RuleTable& rules, const std::function<bool(int)>& held) {
+	TRACE_SCOPE("governor", "PriorityGovernor::Sample");
+	std::vector<GovernorStep> steps;
+	++pass;
+	DIR* proc = opendir("/proc");
+	if (!proc) return steps;
+
+	while (dirent* entry = readdir(proc)) {
+		int pid = atoi(entry->d_name);
+		if (pid <= 0) continue;
+
+		char stat[1024];
+		std::string_view comm;
+		uint64_t cpuNs = 0, startTime = 0;
+		if (!ReadCpuTimes(pid, stat, comm, cpuNs, startTime)) continue; // exited meanwhile
+		uint64_t now = SteadyNs();
+
+		std::string_view exe;
+		char exePath[PATH_MAX], path[32];
+		if (rules.HasPathRules()) {
+			snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+			ssize_t exeLength = readlink(path, exePath, sizeof(exePath));
+			if (exeLength > 0 && exeLength < (ssize_t)sizeof(exePath))
+				exe = std::string_view(exePath, (size_t)exeLength);
+		}
+		const RuleTable::Rule* rule = rules.Find(comm, exe);
+		if (!rule || !rule->Governed()) continue;
+
+		bool fresh;
+		Process& state = Track(pid, startTime, cpuNs, now, *rule, fresh);
+		if (held && held(pid)) {
+			Skip(state, cpuNs, now); // demoted: reapplying its class would undo that
+			continue;
+		}
+		DWORD next;
+		double cpus;
+		if (!fresh && Decide(state, cpuNs, now, *rule, next, cpus)) {
+			GovernorStep step;
+			step.pid = pid;
+			step.name.assign(comm.data(), comm.size());
+			step.from = state.priority;
+			step.to = next;
+			step.cpus = cpus;
+			EnforceResult result = ApplyToThreads(pid, next, *rule);
+			step.applied = result == EnforceResult::Applied || result == EnforceResult::Unchanged;
+			if (step.applied) state.priority = next;
+			if (result != EnforceResult::Gone) steps.push_back(std::move(step));
+		}
+		else {
+			ApplyToThreads(pid, state.priority, *rule); // also catches threads started since
+		}
+	}
+	closedir(proc);
+	Forget();
+	return steps;
+}
+#endif
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "enforce.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Moves running apps between adjacent priority classes by the CPU they actually use. A rule
+// is governed when it gives ",min=" and/or ",max=" around its priority (see
+// RuleTable::Rule::Governed); its processes start at the priority, step down one class when
+// they keep a CPU busy and back up when they go quiet, never past the bounds:
+//   game.exe=High,min=Normal           High while it behaves, Above Normal / Normal when it spins
+//   indexer.exe=Normal,min=Idle,max=Above Normal
+// Hysteresis: a sample counts as busy at busyCpus or more and idle at idleCpus or less, usage
+// in between resets both runs, and a class only changes after holdSamples samples in a row
+// of one kind. After a step the run starts over, so each further step takes as long again.
+// CPU time comes from /proc/<pid>/stat (utime + stime) on Linux and GetProcessTimes on
+// Windows; classes are applied with ApplySchedClass to every thread, or SetPriorityClass.
+
+struct GovernorConfig {
+	unsigned intervalMs = 1000;
+	double busyCpus = 0.8;     // CPUs' worth used over one interval
+	double idleCpus = 0.2;
+	unsigned holdSamples = 3;
+};
+
+struct GovernorStep {
+	int pid = 0;
+	std::string name;  // process name as the system reports it
+	DWORD from = 0;    // CpuPriorityClass values
+	DWORD to = 0;
+	double cpus = 0;   // usage over the sample that made the step
+	bool applied = false;
+};
+
+class PriorityGovernor {
+public:
+	explicit PriorityGovernor(const GovernorConfig& config = GovernorConfig()) : config(config) {}
+
+	const GovernorConfig& Config() const { return config; }
+	size_t Tracked() const { return processes.size(); }
+
+	// One pass over the running processes; the steps taken, failed ones included. A process
+	// seen for the first time is put into its rule's priority, which is not reported.
+	// Processes held returns true for (the watchdog's demotions) are neither touched nor
+	// counted; their samples start over once they are released.
+	std::vector<GovernorStep> Sample(const RuleTable& rules, const std::function<bool(int)>& held = nullptr);
+
+private:
+	struct Process {
+		uint64_t startTime = 0;  // tells a reused PID apart
+		uint64_t cpuNs = 0;      // at the last sample
+		uint64_t sampledNs = 0;
+		DWORD priority = 0;      // class it was put in
+		unsigned busy = 0, idle = 0;
+		uint64_t pass = 0;       // last Sample that saw it
+	};
+
+	// The process' entry, started over when it is new or its PID was reused (fresh)
+	Process& Track(int pid, uint64_t startTime, uint64_t cpuNs, uint64_t nowNs, const RuleTable::Rule& rule, bool& fresh);
+
+	// Count one sample; true, with the class to move to, when a run is long enough or the
+	// rule's bounds moved away from the class the process is in
+	bool Decide(Process& process, uint64_t cpuNs, uint64_t nowNs, const RuleTable::Rule& rule, DWORD& next, double& cpus);
+
+	void Skip(Process& process, uint64_t cpuNs, uint64_t nowNs); // held this pass
+	void Forget(); // processes the last pass did not see
+
+	GovernorConfig config;
+	std::unordered_map<int, Process> processes;
+	uint64_t pass = 0;
+};
@@ -1,10 +1,29 @@
 #include "pch.h"
 #include "resource.h"
+#include "appindex.h"
+#include "cli.h"
+#include "profiles.h"
+#include "regfile.h"
+#include "rules.h"
+#include "snapcache.h"
+#include "store.h"
+#include "sysapps.h"
+#include "trace.h"
+#include "watcher.h"
+#include <algorithm>
+#include <atomic>
 #include <commctrl.h>
 #include <commdlg.h>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
 #include <shellapi.h>
 #include <shlwapi.h>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <windows.h>
 #include <winreg.h>
@@ -12,41 +31,43 @@
 #pragma comment(lib, "shlwapi.lib")
 #pragma comment(lib, "comctl32.lib")
 
-constexpr auto IFEO_PATH = L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\Image File Execution Options"; // Registry path
 constexpr size_t MAX_STRING = 256;
+constexpr UINT WM_STORE_CHANGED = WM_APP + 1; // posted by Watcher
+constexpr UINT WM_SCAN_BATCH = WM_APP + 2;    // lParam = ScanBatch*, posted by Scanner
+constexpr size_t SCAN_BATCH_SIZE = 512;
 
 HINSTANCE hInst;
-HWND hListView, hStatusBar;
+HWND hListView, hStatusBar, hFilterBox;
 bool ShowSystemApps = false;
 bool ShowUnmanagedApps = false;
-constexpr auto DEFAULT_TEXT = L"Default";
-constexpr auto RegPriority = L"CpuPriorityClass";
-constexpr auto RegManaged = L"SetPriorityManaged";
-
-const wchar_t* ConvertHexToName(DWORD priority)
-{
-	switch (priority)
-	{
-	case 1: return L"Idle";
-	case 5: return L"Below Normal";
-	case 2: return L"Normal";
-	case 6: return L"Above Normal";
-	case 3: return L"High";
-	case 4: return L"Realtime";
-	default: return L"(Unknown)";
-	}
-}
-
-DWORD PriorityValues[] = {
-	0,             // Not Set
-	0x00000001,     // Idle
-	0x00000005,     // Below Normal
-	0x00000002,     // Normal
-	0x00000006,     // Above Normal
-	0x00000003,     // High
-	0x00000004      // Realtime
+std::unique_ptr<PriorityStore> Store;
+std::vector<AppRecord> Apps; // last snapshot, shared by ListApps and the dialogs
+std::vector<size_t> Rows;    // Apps index of every visible ListView row, ascending
+AppIndex AppNames;           // over Apps; kept in step wherever Apps changes
+std::wstring Filter;         // name prefix typed into hFilterBox
+SystemAppClassifier SystemApps(DefaultSystemDirectories());
+SnapshotCache Cache(DefaultSnapshotPath()); // the last scan, shown at startup before the registry is read
+bool LiveRegistry = true;                   // false once a .reg export is open in its place
+StoreWatcher Watcher;
+
+// Records streamed from the Scanner thread to the UI thread
+struct ScanBatch {
+	unsigned generation = 0;
+	bool replace = false; // append to Apps as it arrives, otherwise diff against Apps once complete
+	bool done = false;
+	std::vector<AppRecord> records; // replace scans only
+	std::shared_ptr<const std::vector<AppRecord>> snapshot; // done: every key the scan read
 };
 
+std::thread Scanner;
+std::atomic<unsigned> ScanGeneration{ 0 }; // bumping it cancels the running scan
+bool ScanAnnounce = false;                 // UI thread only: report the diff in the status bar
+bool ScanLoading = false;                  // UI thread only: the status bar still says "Loading..."
+std::wstring PendingSelect;                // UI thread only: select this app once the scan lands
+std::shared_ptr<const std::vector<AppRecord>> LastScan; // what the last finished scan read; the next one
+                                                        // skips keys whose stamp still matches it
+constexpr auto DEFAULT_TEXT = L"Default";
+
 void CenterWindow(HWND hwnd) { // make everything centered
 	RECT rcWnd, rcScreen;
 	GetWindowRect(hwnd, &rcWnd);
@@ -84,18 +105,9 @@ static bool ResolveFullPath(const std::wstring& exeName, std::wstring& outPath)
 }
 
 static bool IsSystemApp(const std::wstring& exeName) {
-	WCHAR path[MAX_PATH], systemPath[MAX_PATH];
-	GetSystemDirectoryW(systemPath, MAX_PATH);
-	PathCombineW(path, systemPath, exeName.c_str());
-	if (PathFileExistsW(path)) return TRUE;
-
-	WCHAR windowsPath[MAX_PATH];
-	if (GetWindowsDirectoryW(windowsPath, MAX_PATH)) {
-		PathCombineW(path, windowsPath, L"SysWOW64");
-		PathCombineW(path, path, exeName.c_str());
-		if (PathFileExistsW(path)) return TRUE;
-	}
-	return FALSE;
+	TRACE_SCOPE("sysapps", "IsSystemApp");
+	SystemApps.Refresh(); // no-op unless System32/SysWOW64 changed
+	return SystemApps.Contains(exeName);
 }
 
 static bool CheckSystemApp(HWND parent, const std::wstring& appName) {
@@ -106,98 +118,6 @@ static bool CheckSystemApp(HWND parent, const std::wstring& appName) {
 	return true;
 }
 
-std::vector<std::wstring> GetApps() {
-	HKEY hKey;
-	std::vector<std::wstring> appList;
-
-	if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, IFEO_PATH, 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
-		WCHAR name[256];
-		DWORD nameSize, index = 0;
-
-		while (true) {
-			nameSize = _countof(name);
-			if (RegEnumKeyExW(hKey, index++, name, &nameSize, NULL, NULL, NULL, NULL) != ERROR_SUCCESS)
-				break;
-
-			if (_wcsicmp(name, L"{ApplicationVerifierGlobalSettings}") == 0)
-				continue; // skip this key
-
-			appList.push_back(name);
-		}
-		RegCloseKey(hKey);
-	}
-	return appList;
-}
-
-std::wstring GetRegPath(const std::wstring& appName) {
-	return IFEO_PATH + std::wstring(L"\\") + appName + L"\\PerfOptions";
-}
-
-static bool GetPriority(const std::wstring& appName, DWORD& priority) {
-	std::wstring subkey = GetRegPath(appName);
-	HKEY hKey;
-	if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, subkey.c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
-		DWORD dataSize = sizeof(DWORD);
-		LONG result = RegQueryValueExW(hKey, RegPriority, NULL, NULL, (LPBYTE)&priority, &dataSize);
-		RegCloseKey(hKey);
-		return result == ERROR_SUCCESS;
-	}
-	return false;
-}
-
-static void SetPriorityManage(HKEY hKey) {
-	DWORD value = 1;
-	RegSetValueExW(hKey, RegManaged, 0, REG_DWORD,
-		reinterpret_cast<const BYTE*>(&value),
-		sizeof(DWORD)
-	);
-}
-
-static bool SetPriority(const std::wstring& appName, DWORD priority) {
-	std::wstring perfKey = GetRegPath(appName);
-	HKEY hKey;
-	if (RegCreateKeyExW(HKEY_LOCAL_MACHINE, perfKey.c_str(), 0, NULL, 0, KEY_WRITE, NULL, &hKey, NULL) == ERROR_SUCCESS) {
-		LONG result = RegSetValueExW(hKey, RegPriority, 0, REG_DWORD, (const BYTE*)&priority, sizeof(DWORD));
-		SetPriorityManage(hKey);
-		RegCloseKey(hKey);
-		return result == ERROR_SUCCESS;
-	}
-	return false;
-}
-
-static void DefaultPriority(const std::wstring& appName) {
-	std::wstring perfKey = GetRegPath(appName);
-	HKEY hKey;
-	if (RegCreateKeyExW(HKEY_LOCAL_MACHINE, perfKey.c_str(), 0, NULL, 0, KEY_WRITE, NULL, &hKey, NULL) == ERROR_SUCCESS) {
-		SetPriorityManage(hKey);
-		RegCloseKey(hKey);
-	}
-}
-
-static bool RemovePriority(const std::wstring& appName) {
-	std::wstring perfKey = GetRegPath(appName);
-	return RegDeleteTreeW(HKEY_LOCAL_MACHINE, perfKey.c_str()) == ERROR_SUCCESS;
-}
-
-static bool RemoveApp(const std::wstring& appName) {
-	std::wstring appKey = IFEO_PATH + std::wstring(L"\\") + appName;
-	RemovePriority(appName);
-	return RegDeleteKeyW(HKEY_LOCAL_MACHINE, appKey.c_str()) == ERROR_SUCCESS;
-}
-
-static bool IsSetPriorityApp(const std::wstring& appName) {
-	std::wstring subkey = GetRegPath(appName);
-	HKEY hKey;
-	if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, subkey.c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
-		DWORD value = 0;
-		DWORD valueSize = sizeof(DWORD);
-		LONG result = RegQueryValueExW(hKey, RegManaged, NULL, NULL, (LPBYTE)&value, &valueSize);
-		RegCloseKey(hKey);
-		return (result == ERROR_SUCCESS && value == 1);
-	}
-	return false;
-}
-
 static void SetStatus(const std::wstring& text) {
 	if (hStatusBar) {
 		SendMessageW(hStatusBar, SB_SETTEXT, 0, (LPARAM)text.c_str());
@@ -220,6 +140,24 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 	_In_ LPWSTR    lpCmdLine,
 	_In_ int       nCmdShow)
 {
+	if (lpCmdLine && *lpCmdLine) {
+		// headless mode: no windows, no elevation prompt, no single-instance check
+		int argc = 0;
+		LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+		std::vector<std::wstring> args;
+		for (int i = 1; argv && i < argc; ++i)
+			args.push_back(argv[i]);
+		if (argv) LocalFree(argv);
+
+		// a GUI-subsystem process has no console of its own; borrow the caller's unless redirected
+		if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+			FILE* stream;
+			if (!GetStdHandle(STD_OUTPUT_HANDLE)) freopen_s(&stream, "CONOUT$", "w", stdout);
+			if (!GetStdHandle(STD_ERROR_HANDLE)) freopen_s(&stream, "CONOUT$", "w", stderr);
+		}
+		return RunCommandLine(args, std::wcout, std::wcerr);
+	}
+
 	if (!IsRunningAsAdmin()) {
 		wchar_t szPath[MAX_PATH];
 		if (GetModuleFileNameW(NULL, szPath, MAX_PATH)) {
@@ -242,7 +180,9 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 	}
 
 	UNREFERENCED_PARAMETER(hPrevInstance);
-	UNREFERENCED_PARAMETER(lpCmdLine);
+
+	Store = std::make_unique<RegistryStore>();
+	EnableTracing(true); // cheap enough to leave on; Menu > Save Trace writes it out
 
 	// Initialize global strings
 	LoadStringW(hInstance, IDS_APP_TITLE, szTitle, MAX_STRING);
@@ -289,72 +229,572 @@ static void PriorityList(HWND hDlg) {
 	SendDlgItemMessageW(hDlg, IDC_PRIORITY_COMBO, CB_SETCURSEL, 0, 0); // Default selection
 }
 
-static void ListApps(bool updateStatus = true) {
-	if (!hListView) return;
+// I/O and page priority combos: "Default", then one entry per registry value
+static void LevelList(HWND hDlg, int comboId, const wchar_t* const* names, size_t count, bool set, DWORD value) {
+	SendDlgItemMessageW(hDlg, comboId, CB_ADDSTRING, 0, (LPARAM)DEFAULT_TEXT);
+	for (size_t i = 0; i < count; ++i) {
+		std::wstring item = std::to_wstring(i) + L" - " + names[i];
+		SendDlgItemMessageW(hDlg, comboId, CB_ADDSTRING, 0, (LPARAM)item.c_str());
+	}
+	SendDlgItemMessageW(hDlg, comboId, CB_SETCURSEL, set && value < count ? value + 1 : 0, 0);
+}
 
-	ListView_DeleteAllItems(hListView);
+static void ShowLevels(HWND hDlg, const AppRecord& app) {
+	LevelList(hDlg, IDC_IO_COMBO, IoPriorityNames, std::size(IoPriorityNames), app.hasIoPriority, app.ioPriority);
+	LevelList(hDlg, IDC_PAGE_COMBO, PagePriorityNames, std::size(PagePriorityNames), app.hasPagePriority, app.pagePriority);
+}
 
-	auto apps = GetApps();
-	int userCount = 0, systemCount = 0, managedCount = 0;
+// registry value of the selection, -1 for Default
+static int SelectedLevel(HWND hDlg, int comboId) {
+	return (int)SendDlgItemMessageW(hDlg, comboId, CB_GETCURSEL, 0, 0) - 1;
+}
+
+// CPU set and NUMA node boxes shared by the Add and Edit dialogs
+static void ShowPlacement(HWND hDlg, const AppRecord& app) {
+	SetDlgItemTextW(hDlg, IDC_CPUSET, app.cpuSet.c_str());
+	if (app.numaNode >= 0)
+		SetDlgItemInt(hDlg, IDC_NUMA_NODE, app.numaNode, FALSE);
+}
+
+static bool ReadPlacement(HWND hDlg, std::wstring& cpuSet, int& numaNode) {
+	WCHAR text[256];
+	GetDlgItemTextW(hDlg, IDC_CPUSET, text, _countof(text));
+	if (!NormalizeCpuList(text, cpuSet)) {
+		MessageBoxW(hDlg, L"CPUs must be a list such as \"0-3,8\", or blank for any CPU.", L"Error", MB_ICONERROR);
+		SetFocus(GetDlgItem(hDlg, IDC_CPUSET));
+		return false;
+	}
+
+	numaNode = -1;
+	GetDlgItemTextW(hDlg, IDC_NUMA_NODE, text, _countof(text));
+	if (text[0]) {
+		BOOL valid = FALSE;
+		UINT node = GetDlgItemInt(hDlg, IDC_NUMA_NODE, &valid, FALSE);
+		if (!valid || node >= MAX_CPUS) {
+			MessageBoxW(hDlg, L"NUMA node must be a node number, or blank for none.", L"Error", MB_ICONERROR);
+			SetFocus(GetDlgItem(hDlg, IDC_NUMA_NODE));
+			return false;
+		}
+		numaNode = (int)node;
+	}
+	return true;
+}
+
+static AppRecord* FindApp(const std::wstring& appName) {
+	size_t index = AppNames.Find(appName);
+	return index == AppIndex::NONE ? nullptr : &Apps[index];
+}
+
+static const wchar_t* PriorityText(const AppRecord& app) {
+	return app.hasPriority ? ConvertHexToName(app.priority) : DEFAULT_TEXT;
+}
+
+template <size_t N>
+static const wchar_t* LevelText(bool set, DWORD value, const wchar_t* const (&names)[N]) {
+	if (!set) return DEFAULT_TEXT;
+	return value < N ? names[value] : L"(Unknown)";
+}
+
+static const wchar_t* ColumnText(const AppRecord& app, int column) {
+	switch (column)
+	{
+	case 0: return app.name.c_str();
+	case 1: return PriorityText(app);
+	case 2: return LevelText(app.hasIoPriority, app.ioPriority, IoPriorityNames);
+	case 3: return LevelText(app.hasPagePriority, app.pagePriority, PagePriorityNames);
+	default: return L"";
+	}
+}
+
+static const AppRecord* RowApp(int row) {
+	if (row < 0 || (size_t)row >= Rows.size()) return nullptr;
+	return &Apps[Rows[row]];
+}
+
+static int FindRow(const std::wstring& appName) {
+	size_t index = AppNames.Find(appName);
+	auto row = std::lower_bound(Rows.begin(), Rows.end(), index);
+	return row != Rows.end() && *row == index ? int(row - Rows.begin()) : -1;
+}
+
+static bool IsVisible(const AppRecord& app) {
+	if (app.system) { //fix
+		if (!app.managed && !ShowSystemApps)
+			return false; // Skip un-managed system app unless ShowSystemApps is enabled
+	}
+	else {
+		if (!ShowUnmanagedApps && !app.managed)
+			return false; // Skip non-system apps not managed by SetPriority
+	}
+	return true;
+}
+
+static bool MatchesFilter(const AppRecord& app) {
+	return Filter.empty() || _wcsnicmp(app.name.c_str(), Filter.c_str(), Filter.size()) == 0;
+}
+
+static void SetRowCount(DWORD countFlags) {
+	ListView_SetItemCountEx(hListView, (int)Rows.size(), countFlags);
+	if (!(countFlags & LVSICF_NOINVALIDATEALL))
+		InvalidateRect(hListView, nullptr, FALSE);
+}
+
+// Add visible Apps[from..] to Rows and resize the virtual list; no store access
+static void AppendRows(size_t from, DWORD countFlags = 0) {
+	TRACE_SCOPE("ui", "AppendRows");
+	for (size_t i = from; i < Apps.size(); ++i) {
+		if (IsVisible(Apps[i]) && MatchesFilter(Apps[i]))
+			Rows.push_back(i); // text is served on demand via LVN_GETDISPINFO
+	}
+	SetRowCount(countFlags);
+}
 
-	for (const auto& app : apps) {
-		bool isSystem = IsSystemApp(app);
-		if (isSystem) systemCount++;
+// "Found N user app(s), ..." over Apps
+static void ShowSummary() {
+	int userCount = 0, systemCount = 0, managedCount = 0;
+	for (const auto& app : Apps) {
+		if (app.system) systemCount++;
 		else userCount++;
 
-		if (IsSetPriorityApp(app)) {
+		if (app.managed) {
 			managedCount++;
 		}
+	}
+
+	std::wstring status =
+		L"Found " + std::to_wstring(userCount) + L" user app(s), " +
+		std::to_wstring(systemCount) + L" system app(s), " +
+		std::to_wstring(managedCount) + L" managed by SetPriority";
+	SetStatus(status);
+}
 
-		if (isSystem) { //fix
-			if (!IsSetPriorityApp(app) && !ShowSystemApps)
-				continue; // Skip un-managed system app unless ShowSystemApps is enabled
+static void ShowRows(bool updateStatus, DWORD countFlags = 0) {
+	TRACE_SCOPE("ui", "ShowRows");
+	Rows.clear();
+	if (Filter.empty()) {
+		AppendRows(0, countFlags);
+	}
+	else {
+		// only the apps with the prefix are looked at, not the whole list
+		AppNames.WithPrefix(Filter, Rows);
+		Rows.erase(std::remove_if(Rows.begin(), Rows.end(), [](size_t i) { return !IsVisible(Apps[i]); }), Rows.end());
+		SetRowCount(countFlags);
+	}
+
+	if (updateStatus) ShowSummary();
+}
+
+static void SelectRow(int row) {
+	ListView_SetItemState(hListView, -1, 0, LVIS_SELECTED | LVIS_FOCUSED);
+	if (row >= 0) {
+		ListView_SetItemState(hListView, row, LVIS_SELECTED | LVIS_FOCUSED, LVIS_SELECTED | LVIS_FOCUSED);
+		ListView_EnsureVisible(hListView, row, FALSE);
+	}
+}
+
+static void PostBatch(HWND hWnd, std::unique_ptr<ScanBatch> batch) {
+	if (PostMessageW(hWnd, WM_SCAN_BATCH, 0, (LPARAM)batch.get()))
+		batch.release(); // owned by the message now, or by DropScanBatches
+}
+
+// Walk the store on the Scanner thread. A replace scan streams batches into an emptied
+// list so the first screenful shows up right away; otherwise the finished snapshot is
+// diffed against Apps, and keys whose last-write time still matches their record in
+// LastScan are not read again. LastScan is shared, not copied, so starting a scan costs the
+// UI thread nothing per key. Starting a scan cancels the one in flight.
+static void StartScan(bool replace, bool announce = false) {
+	if (!hListView) return;
+
+	unsigned generation = ++ScanGeneration;
+	if (Scanner.joinable()) Scanner.join(); // stops at its next record
+
+	SystemApps.Refresh(); // on this thread; batches are classified as they land
+	ScanAnnounce = announce;
+	if (replace) {
+		Apps.clear();
+		AppNames.Clear();
+		ShowRows(false);
+		SetStatus(L"Loading...");
+		ScanLoading = true;
+		LastScan.reset(); // a new store, or a full reload: trust nothing read before
+	}
+
+	HWND hWnd = GetParent(hListView);
+	Scanner = std::thread([hWnd, generation, replace, previous = LastScan] {
+		auto batch = std::make_unique<ScanBatch>();
+		batch->generation = generation;
+		batch->replace = replace;
+
+		TRACE_SCOPE("ui", "scan");
+		std::unordered_map<std::wstring, const AppRecord*> known;
+		if (previous) {
+			known.reserve(previous->size());
+			for (const auto& app : *previous)
+				known.emplace(FoldCase(app.name), &app);
+		}
+		auto lookup = [&known](const std::wstring& name) -> const AppRecord* {
+			auto it = known.find(FoldCase(name));
+			return it == known.end() ? nullptr : it->second;
+		};
+
+		auto snapshot = std::make_shared<std::vector<AppRecord>>();
+		snapshot->reserve(previous ? previous->size() : 0);
+		Store->ForEachChangedApp(lookup, [&](const AppRecord& app) {
+			if (ScanGeneration != generation) return false;
+
+			snapshot->push_back(app);
+			if (replace) {
+				batch->records.push_back(app);
+				if (batch->records.size() == SCAN_BATCH_SIZE) {
+					PostBatch(hWnd, std::move(batch));
+					batch = std::make_unique<ScanBatch>();
+					batch->generation = generation;
+					batch->replace = true;
+				}
+			}
+			return true;
+		});
+
+		if (ScanGeneration != generation) return;
+		batch->done = true;
+		batch->snapshot = std::move(snapshot);
+		PostBatch(hWnd, std::move(batch));
+	});
+}
+
+static void StopScan() {
+	++ScanGeneration;
+	if (Scanner.joinable()) Scanner.join();
+}
+
+// Free the batches still queued once the window is going away; nothing reads them after WM_DESTROY
+static void DropScanBatches(HWND hWnd) {
+	MSG msg;
+	while (PeekMessageW(&msg, hWnd, WM_SCAN_BATCH, WM_SCAN_BATCH, PM_REMOVE))
+		delete (ScanBatch*)msg.lParam;
+}
+
+static void ListApps() {
+	StartScan(true); // ends with the summary in the status bar
+}
+
+// Show the cached list right away and bring it up to date behind it; false when there is
+// no usable cache
+static bool ListCachedApps() {
+	std::vector<AppRecord> cached;
+	if (!Cache.Load(cached)) return false;
+	std::sort(cached.begin(), cached.end(), [](const AppRecord& a, const AppRecord& b) {
+		return NoCaseLess()(a.name, b.name);
+	});
+	Apps = std::move(cached);
+	LastScan = std::make_shared<const std::vector<AppRecord>>(Apps); // its stamps spare the first scan most reads
+	AppNames.Build(Apps);
+	ShowRows(true);
+	StartScan(false);
+	return true;
+}
+
+// Patch Apps with only what changed between it and the latest snapshot
+static void ApplyStoreChanges(const std::vector<AppRecord>& latest, bool announce) {
+	TRACE_SCOPE("ui", "ApplyStoreChanges");
+	SnapshotDiff diff = DiffSnapshots(Apps, latest);
+
+	int selIndex = ListView_GetNextItem(hListView, -1, LVNI_SELECTED);
+	const AppRecord* selected = RowApp(selIndex);
+	std::wstring selectedName = PendingSelect.empty() && selected ? selected->name : PendingSelect;
+	PendingSelect.clear();
+
+	for (const auto& app : diff.changed) {
+		AppRecord* current = FindApp(app.name);
+		bool system = current->system;
+		*current = app;
+		current->system = system;
+	}
+
+	if (diff.added.empty() && diff.removed.empty()) {
+		// same keys in the same order: repaint just the changed rows, unless one was shown or hidden
+		std::vector<size_t> before = Rows;
+		ShowRows(false, LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL);
+		if (Rows != before) {
+			InvalidateRect(hListView, nullptr, FALSE);
 		}
 		else {
-			if (!ShowUnmanagedApps && !IsSetPriorityApp(app))
-				continue; // Skip non-system apps not managed by SetPriority
+			for (const auto& app : diff.changed) {
+				int row = FindRow(app.name);
+				if (row >= 0) ListView_RedrawItems(hListView, row, row);
+			}
+		}
+	}
+	else {
+		std::unordered_set<std::wstring> removed;
+		for (const auto& name : diff.removed)
+			removed.insert(FoldCase(name));
+		Apps.erase(std::remove_if(Apps.begin(), Apps.end(), [&](const AppRecord& app) {
+			return removed.count(FoldCase(app.name)) != 0;
+		}), Apps.end());
+
+		for (auto& app : diff.added) {
+			app.system = SystemApps.Contains(app.name);
+			auto at = std::upper_bound(Apps.begin(), Apps.end(), app, [](const AppRecord& a, const AppRecord& b) {
+				return NoCaseLess()(a.name, b.name);
+			});
+			Apps.insert(at, app);
 		}
+		AppNames.Build(Apps);
+		ShowRows(false, LVSICF_NOSCROLL);
+	}
 
-		// insert into ListView
-		LVITEMW lvItem{};
-		lvItem.mask = LVIF_TEXT;
-		lvItem.iItem = ListView_GetItemCount(hListView);
-		lvItem.iSubItem = 0;
-		lvItem.pszText = (LPWSTR)app.c_str();
-		ListView_InsertItem(hListView, &lvItem);
+	// unchanged values can still come with a new stamp; keep it so the next scan can skip the key
+	for (const auto& app : latest) {
+		if (AppRecord* current = FindApp(app.name)) current->lastWrite = app.lastWrite;
+	}
+
+	// keep the selection on the same app, or on the same row if that app is gone
+	int row = selectedName.empty() ? -1 : FindRow(selectedName);
+	if (row < 0 && selIndex >= 0 && !Rows.empty())
+		row = (std::min)(selIndex, (int)Rows.size() - 1);
+	SelectRow(row);
 
-		DWORD priority;
-		const wchar_t* prioName = GetPriority(app, priority) ? ConvertHexToName(priority) : DEFAULT_TEXT;
-		ListView_SetItemText(hListView, lvItem.iItem, 1, const_cast<LPWSTR>(prioName));
+	if (announce && !diff.Empty()) {
+		SetStatus(L"Registry changed: " + std::to_wstring(diff.added.size()) + L" added, " +
+			std::to_wstring(diff.removed.size()) + L" removed, " +
+			std::to_wstring(diff.changed.size()) + L" changed");
 	}
+}
 
-	if (updateStatus) {
-		std::wstring status =
-			L"Found " + std::to_wstring(userCount) + L" user app(s), " +
-			std::to_wstring(systemCount) + L" system app(s), " +
-			std::to_wstring(managedCount) + L" managed by SetPriority";
-		SetStatus(status);
+static void OnScanBatch(ScanBatch* raw) {
+	std::unique_ptr<ScanBatch> batch(raw);
+	if (batch->generation != ScanGeneration) return; // superseded by a newer scan
+	TRACE_SCOPE("ui", "OnScanBatch");
+
+	{
+		TRACE_SCOPE("sysapps", "classify batch");
+		for (auto& app : batch->records)
+			app.system = SystemApps.Contains(app.name);
+	}
+
+	if (!batch->replace) {
+		ApplyStoreChanges(*batch->snapshot, ScanAnnounce);
+		LastScan = std::move(batch->snapshot);
+		if (ScanLoading) ShowSummary(); // it took over from a replace scan
+		ScanLoading = false;
+		if (LiveRegistry) Cache.Save(Apps);
+		return;
+	}
+
+	size_t from = Apps.size();
+	Apps.insert(Apps.end(), std::make_move_iterator(batch->records.begin()), std::make_move_iterator(batch->records.end()));
+	AppNames.Append(Apps, from);
+	AppendRows(from, LVSICF_NOSCROLL);
+
+	if (!batch->done) {
+		SetStatus(L"Loading... " + std::to_wstring(Apps.size()) + L" app(s)");
+		return;
+	}
+
+	// RegEnumKeyExW lists keys folded to upper case, NoCaseLess folds to lower, and names with
+	// '_', '[' or '^' land differently. ApplyStoreChanges inserts by binary search, so put
+	// the whole list in NoCaseLess order once it has arrived.
+	auto byName = [](const AppRecord& a, const AppRecord& b) { return NoCaseLess()(a.name, b.name); };
+	if (!std::is_sorted(Apps.begin(), Apps.end(), byName)) {
+		std::sort(Apps.begin(), Apps.end(), byName);
+		AppNames.Build(Apps);
+		ShowRows(true, LVSICF_NOSCROLL); // rows moved: repaint them all
+	}
+	else {
+		ShowRows(true, LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL);
+	}
+	ScanLoading = false;
+	LastScan = std::move(batch->snapshot);
+	if (LiveRegistry) Cache.Save(Apps);
+	if (!PendingSelect.empty()) {
+		SelectRow(FindRow(PendingSelect));
+		PendingSelect.clear();
 	}
 }
 
+// Re-read the store after an edit without losing the selection or scroll position
 void StoreSelection() {
-	if (!hListView) return;
+	StartScan(false);
+}
 
-	int selIndex = ListView_GetNextItem(hListView, -1, LVNI_SELECTED);
-	int topIndex = ListView_GetTopIndex(hListView);
+static bool PickRuleFile(HWND parent, bool save, WCHAR (&filePath)[MAX_PATH], const wchar_t* initialDir = nullptr) {
+	filePath[0] = L'\0';
+	OPENFILENAMEW ofn = { sizeof(ofn) };
+	ofn.hwndOwner = parent;
+	ofn.lpstrInitialDir = initialDir;
+	ofn.lpstrFilter = L"Rule Files (*.txt)\0*.txt\0All Files (*.*)\0*.*\0";
+	ofn.lpstrFile = filePath;
+	ofn.nMaxFile = MAX_PATH;
+	ofn.lpstrDefExt = L"txt";
+	if (save) {
+		ofn.Flags = OFN_OVERWRITEPROMPT | OFN_PATHMUSTEXIST;
+		return GetSaveFileNameW(&ofn) != FALSE;
+	}
+	ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
+	return GetOpenFileNameW(&ofn) != FALSE;
+}
 
-	ListApps(false); // don't update status here
+// Rules go straight from the file to the store; the list catches up through the usual re-read
+static void ImportFile(HWND parent) {
+	WCHAR filePath[MAX_PATH];
+	if (!PickRuleFile(parent, false, filePath)) return;
+
+	std::ifstream in(filePath, std::ios::binary);
+	if (!in) {
+		MessageBoxW(parent, L"Cannot open the rule file.", L"Error", MB_ICONERROR);
+		return;
+	}
 
-	if (selIndex >= 0) {
-		ListView_SetItemState(hListView, selIndex, LVIS_SELECTED | LVIS_FOCUSED, LVIS_SELECTED | LVIS_FOCUSED);
-		ListView_EnsureVisible(hListView, selIndex, FALSE);
+	HCURSOR oldCursor = SetCursor(LoadCursor(nullptr, IDC_WAIT));
+	size_t firstBadLine = 0;
+	ImportResult result = ImportRules(*Store, in, [&](size_t lineNo, const std::wstring&) {
+		if (!firstBadLine) firstBadLine = lineNo;
+	});
+	SetCursor(oldCursor);
+
+	StoreSelection();
+	std::wstring status = L"Imported " + std::to_wstring(result.applied) + L" rule(s)";
+	if (result.failed) {
+		status += L", " + std::to_wstring(result.failed) + L" failed (first at line " + std::to_wstring(firstBadLine) + L")";
 	}
+	SetStatus(status);
+}
+
+static void ExportFile(HWND parent) {
+	int answer = MessageBoxW(parent, L"Also export apps that are not managed by SetPriority?",
+		L"Export Rules", MB_ICONQUESTION | MB_YESNOCANCEL);
+	if (answer == IDCANCEL) return;
 
-	ListView_Scroll(hListView, 0, topIndex - ListView_GetTopIndex(hListView));
+	WCHAR filePath[MAX_PATH];
+	if (!PickRuleFile(parent, true, filePath)) return;
+
+	std::ofstream out(filePath, std::ios::binary | std::ios::trunc);
+	size_t written = out ? ExportRules(*Store, out, answer == IDYES) : 0;
+	if (!out.flush()) {
+		MessageBoxW(parent, L"Cannot write the rule file.", L"Error", MB_ICONERROR);
+		return;
+	}
+	SetStatus(L"Exported " + std::to_wstring(written) + L" rule(s) to \"" + filePath + L"\"");
+}
+
+// Profiles are rule files kept in one folder, which the dialogs open on
+static std::wstring ProfileFolder() {
+	std::filesystem::path dir = DefaultProfileDirectory();
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	return dir.wstring();
+}
+
+// Only apps whose settings differ are written, in one batch: all of the profile or none of it
+static void SwitchProfileFile(HWND parent) {
+	std::wstring folder = ProfileFolder();
+	WCHAR filePath[MAX_PATH];
+	if (!PickRuleFile(parent, false, filePath, folder.c_str())) return;
+
+	std::ifstream in(filePath, std::ios::binary);
+	if (!in) {
+		MessageBoxW(parent, L"Cannot open the profile.", L"Error", MB_ICONERROR);
+		return;
+	}
+
+	HCURSOR oldCursor = SetCursor(LoadCursor(nullptr, IDC_WAIT));
+	size_t firstBadLine = 0;
+	ProfileSwitch result = SwitchProfile(*Store, in, [&](size_t lineNo, const std::wstring&) {
+		if (!firstBadLine) firstBadLine = lineNo;
+	});
+	SetCursor(oldCursor);
+
+	if (result.failed) {
+		std::wstring text = L"Line " + std::to_wstring(firstBadLine) + L" of the profile is not a rule. Nothing was changed.";
+		MessageBoxW(parent, text.c_str(), L"Error", MB_ICONERROR);
+		return;
+	}
+	if (!result.committed) {
+		MessageBoxW(parent, L"Cannot write the profile's settings. Nothing was changed.", L"Error", MB_ICONERROR);
+		return;
+	}
+
+	StoreSelection();
+	SetStatus(L"Switched to \"" + std::filesystem::path(filePath).stem().wstring() + L"\": " +
+		std::to_wstring(result.added) + L" added, " + std::to_wstring(result.changed) + L" changed, " +
+		std::to_wstring(result.released) + L" released, " + std::to_wstring(result.unchanged) + L" unchanged");
+}
+
+static void SaveProfileFile(HWND parent) {
+	std::wstring folder = ProfileFolder();
+	WCHAR filePath[MAX_PATH];
+	if (!PickRuleFile(parent, true, filePath, folder.c_str())) return;
+
+	if (!SaveProfile(*Store, filePath)) {
+		MessageBoxW(parent, L"Cannot write the profile.", L"Error", MB_ICONERROR);
+		return;
+	}
+	SetStatus(L"Saved the managed apps as profile \"" + std::filesystem::path(filePath).stem().wstring() + L"\"");
+}
+
+// Everything traced so far as a Chrome trace, plus the costliest steps in the status bar
+static void SaveTrace(HWND parent) {
+	WCHAR filePath[MAX_PATH] = L"";
+	OPENFILENAMEW ofn = { sizeof(ofn) };
+	ofn.hwndOwner = parent;
+	ofn.lpstrFilter = L"Trace Files (*.json)\0*.json\0All Files (*.*)\0*.*\0";
+	ofn.lpstrFile = filePath;
+	ofn.nMaxFile = MAX_PATH;
+	ofn.lpstrDefExt = L"json";
+	ofn.Flags = OFN_OVERWRITEPROMPT | OFN_PATHMUSTEXIST;
+	if (!GetSaveFileNameW(&ofn)) return;
+
+	std::vector<TraceEvent> events = CollectTrace();
+	std::ofstream out(filePath, std::ios::binary | std::ios::trunc);
+	if (out) WriteChromeTrace(events, out);
+	if (!out.flush()) {
+		MessageBoxW(parent, L"Cannot write the trace file.", L"Error", MB_ICONERROR);
+		return;
+	}
+
+	std::vector<TraceStat> stats = SummarizeTrace(events);
+	std::wstring status = L"Saved " + std::to_wstring(events.size()) + L" trace event(s)";
+	for (size_t i = 0; i < stats.size() && i < 2; ++i)
+		status += (i ? L"; " : L" - ") + FormatTraceStat(stats[i]);
+	SetStatus(status);
+}
+
+// Browse another machine's settings from a `reg export` dump of IFEO. The dump replaces the
+// registry for the rest of the session, read-only: edits fail and the list stops watching.
+static void OpenExport(HWND parent) {
+	WCHAR filePath[MAX_PATH] = L"";
+	OPENFILENAMEW ofn = { sizeof(ofn) };
+	ofn.hwndOwner = parent;
+	ofn.lpstrFilter = L"Registry Files (*.reg)\0*.reg\0All Files (*.*)\0*.*\0";
+	ofn.lpstrFile = filePath;
+	ofn.nMaxFile = MAX_PATH;
+	ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
+	if (!GetOpenFileNameW(&ofn)) return;
+
+	HCURSOR oldCursor = SetCursor(LoadCursor(nullptr, IDC_WAIT));
+	auto dump = std::make_unique<RegFileStore>(std::filesystem::path(filePath));
+	bool loaded = dump->Load();
+	SetCursor(oldCursor);
+	if (!loaded) {
+		MessageBoxW(parent, L"Cannot read the file as a registry export.", L"Error", MB_ICONERROR);
+		return;
+	}
+
+	Watcher.Stop();
+	StopScan();
+	Store = std::move(dump);
+	LiveRegistry = false; // the snapshot cache belongs to the registry
+	SetWindowTextW(parent, (std::wstring(szTitle) + L" - " + filePath + L" (read-only)").c_str());
+	ListApps();
 }
 
 static void RefreshList(HWND parent, const std::wstring& appName) {
-	INT_PTR result = DialogBoxParam(hInst, MAKEINTRESOURCE(IDD_EDIT), parent, EditDlg, (LPARAM)&appName);
+	const AppRecord* found = FindApp(appName);
+	if (!found) return;
+
+	AppRecord app = *found; // copy: Apps can be rebuilt while the dialog is open
+	INT_PTR result = DialogBoxParam(hInst, MAKEINTRESOURCE(IDD_EDIT), parent, EditDlg, (LPARAM)&app);
 	if (result == IDOK || result == 1001) {
 		StoreSelection(); // Refresh without status overwrite
 	}
@@ -402,9 +842,18 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
 
 	InitCommonControls();
 
+	constexpr int filterHeight = 24;
+	hFilterBox = CreateWindowExW(WS_EX_CLIENTEDGE, WC_EDITW, nullptr,
+		WS_CHILD | WS_VISIBLE | WS_TABSTOP | ES_AUTOHSCROLL,
+		0, 0, windowWidth, filterHeight,
+		hWnd, (HMENU)FILTERBOX, hInst, nullptr
+	);
+	SendMessageW(hFilterBox, WM_SETFONT, (WPARAM)GetStockObject(DEFAULT_GUI_FONT), FALSE);
+	SendMessageW(hFilterBox, EM_SETCUEBANNER, TRUE, (LPARAM)L"Filter: type the start of an app name");
+
 	hListView = CreateWindowExW(0, WC_LISTVIEW, nullptr,
-		WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL,
-		0, 0, windowWidth, 450,
+		WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL | LVS_OWNERDATA,
+		0, filterHeight, windowWidth, 450 - filterHeight,
 		hWnd, (HMENU)LISTVIEW, hInst, nullptr
 	);
 
@@ -420,8 +869,10 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
 		const wchar_t* text;
 		int width;
 	} columns[] = {
-		{ L"Application Name", 314 },
-		{ L"Priority",         314 }
+		{ L"Application Name", 260 },
+		{ L"Priority",         140 },
+		{ L"I/O Priority",     114 },
+		{ L"Page Priority",    114 }
 	};
 
 	for (int i = 0; i < _countof(columns); ++i) {
@@ -433,7 +884,11 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
 		ListView_InsertColumn(hListView, i, &col);
 	}
 
-	ListApps();
+	if (!ListCachedApps())
+		ListApps();
+
+	// keep the list live when other tools (GPO, installers, scripts) edit IFEO
+	Watcher.Start(*Store, [hWnd] { PostMessageW(hWnd, WM_STORE_CHANGED, 0, 0); });
 	return TRUE;
 }
 
@@ -464,6 +919,46 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 			ListApps();
 			break;
 
+		case FILTERBOX:
+			if (HIWORD(wParam) == EN_CHANGE) {
+				WCHAR text[MAX_PATH];
+				GetWindowTextW(hFilterBox, text, _countof(text));
+				Filter = text;
+
+				int selIndex = ListView_GetNextItem(hListView, -1, LVNI_SELECTED);
+				const AppRecord* selected = RowApp(selIndex);
+				std::wstring selectedName = selected ? selected->name : L"";
+				ShowRows(Filter.empty());
+				SelectRow(selectedName.empty() ? -1 : FindRow(selectedName));
+				if (!Filter.empty())
+					SetStatus(std::to_wstring(Rows.size()) + L" app(s) starting with \"" + Filter + L"\"");
+			}
+			break;
+
+		case IDM_IMPORT:
+			ImportFile(hWnd);
+			break;
+
+		case IDM_EXPORT:
+			ExportFile(hWnd);
+			break;
+
+		case IDM_SAVE_TRACE:
+			SaveTrace(hWnd);
+			break;
+
+		case IDM_OPEN_EXPORT:
+			OpenExport(hWnd);
+			break;
+
+		case IDM_SWITCH_PROFILE:
+			SwitchProfileFile(hWnd);
+			break;
+
+		case IDM_SAVE_PROFILE:
+			SaveProfileFile(hWnd);
+			break;
+
 		case IDM_SHOW_SYSTEM:
 		{
 			ShowSystemApps = !ShowSystemApps;  // toggle system apps visibility
@@ -472,7 +967,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 			HMENU hMenu = GetMenu(hWnd);
 			CheckMenuItem(hMenu, IDM_SHOW_SYSTEM, ShowSystemApps ? MF_CHECKED : MF_UNCHECKED);
 
-			ListApps();  // refresh list
+			ShowRows(true);  // refilter, the data has not changed
 			break;
 		}
 
@@ -482,7 +977,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 			// update menu checkmark
 			HMENU hMenu = GetMenu(hWnd);
 			CheckMenuItem(hMenu, IDM_SHOW_UNMANAGED, ShowUnmanagedApps ? MF_CHECKED : MF_UNCHECKED);
-			ListApps();  // refresh list
+			ShowRows(true);  // refilter, the data has not changed
 			break;
 		}
 
@@ -490,29 +985,19 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		{
 			std::wstring appPath;
 			if (DialogBoxParam(hInst, MAKEINTRESOURCE(IDD_ADD), hWnd, AddDlg, (LPARAM)&appPath) == IDOK) {
-				ListApps();
-
-				int itemCount = ListView_GetItemCount(hListView);
-				for (int i = 0; i < itemCount; ++i) {
-					WCHAR buf[MAX_STRING] = {};
-					ListView_GetItemText(hListView, i, 0, buf, 255);
-					buf[MAX_STRING - 1] = L'\0';// null-termination
-
-					if (_wcsicmp(buf, appPath.c_str()) == 0) {
-						// Select the item in the ListView
-						ListView_SetItemState(hListView, i, LVIS_SELECTED | LVIS_FOCUSED, LVIS_SELECTED | LVIS_FOCUSED);
-						ListView_EnsureVisible(hListView, i, FALSE);
-						DWORD priority = 0;
-						std::wstring priorityName = DEFAULT_TEXT;
-						if (GetPriority(appPath, priority)) {
-							priorityName = ConvertHexToName(priority);
-						}
-
-						std::wstring status = L"Added app \"" + appPath + L"\" and set priority to " + priorityName;
-						SetStatus(status);
-						break;
-					}
+				PendingSelect = appPath; // selected once the re-read lands
+				if (_wcsnicmp(appPath.c_str(), Filter.c_str(), Filter.size()) != 0)
+					SetWindowTextW(hFilterBox, L""); // the filter would hide it
+				StoreSelection();
+
+				DWORD priority = 0;
+				std::wstring priorityName = DEFAULT_TEXT;
+				if (Store->GetPriority(appPath, priority)) {
+					priorityName = ConvertHexToName(priority);
 				}
+
+				std::wstring status = L"Added app \"" + appPath + L"\" and set priority to " + priorityName;
+				SetStatus(status);
 			}
 		}
 		break;
@@ -520,16 +1005,14 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		case ID_BUTTON_DELETE:
 		{
 			int sel = ListView_GetNextItem(hListView, -1, LVNI_SELECTED);
-			if (sel >= 0) {
-				WCHAR appName[MAX_STRING] = {};
-				ListView_GetItemText(hListView, sel, 0, appName, MAX_STRING);
-				appName[MAX_STRING - 1] = L'\0';
+			if (const AppRecord* app = RowApp(sel)) {
+				std::wstring appName = app->name; // copy: StoreSelection rebuilds Apps
 
 				if (!CheckSystemApp(hWnd, appName)) {
 					break;
 				}
 
-				if (!IsSetPriorityApp(appName)) {
+				if (!app->managed) {
 					std::wstring msg = L"This app is not managed by SetPriority!\nDelete \"" + std::wstring(appName) + L"\"?";
 					if (MessageBoxW(hWnd, msg.c_str(), L"Warning", MB_ICONWARNING | MB_OKCANCEL) != IDOK) {
 						break; // cancel deletion
@@ -542,7 +1025,9 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 					}
 				}
 
-				RemoveApp(appName);
+				WriteBatch batch;
+				batch.RemoveApp(appName);
+				Store->Commit(batch);
 				StoreSelection();
 				std::wstring status = L"Deleted app \"" + std::wstring(appName);
 				SetStatus(status);
@@ -578,11 +1063,17 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 
 		if (list->idFrom == 1001 && list->code == NM_DBLCLK) {
 			LPNMITEMACTIVATE pnmItem = (LPNMITEMACTIVATE)lParam;
-			if (pnmItem->iItem >= 0) {
-				WCHAR appName[MAX_STRING];
-				ListView_GetItemText(hListView, pnmItem->iItem, 0, appName, 256);
-				appName[MAX_STRING - 1] = L'\0'; // null-termination
-				RefreshList(hWnd, appName);
+			if (const AppRecord* app = RowApp(pnmItem->iItem)) {
+				RefreshList(hWnd, app->name);
+			}
+		}
+		if (list->idFrom == 1001 && list->code == LVN_GETDISPINFOW) {
+			NMLVDISPINFOW* info = (NMLVDISPINFOW*)lParam;
+			const AppRecord* app = RowApp(info->item.iItem);
+			if (app && (info->item.mask & LVIF_TEXT)) {
+				// points into Apps, which outlives the paint that asked for it
+				const wchar_t* text = ColumnText(*app, info->item.iSubItem);
+				info->item.pszText = const_cast<LPWSTR>(text);
 			}
 		}
 		if (list->idFrom == 1001 && list->code == NM_CUSTOMDRAW) {
@@ -597,42 +1088,28 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 
 			case CDDS_SUBITEM | CDDS_ITEMPREPAINT:
 			{
-				if (lvcd->iSubItem == 0) { // App Name
-					WCHAR buf[MAX_STRING];
-					ListView_GetItemText(hListView, (int)lvcd->nmcd.dwItemSpec, 0, buf, _countof(buf));
-					buf[MAX_STRING - 1] = L'\0'; // null-termination
+				const AppRecord* app = RowApp((int)lvcd->nmcd.dwItemSpec);
+				if (!app) return CDRF_DODEFAULT;
 
-					if (IsSystemApp(buf)) {
+				if (lvcd->iSubItem == 0) { // App Name
+					if (app->system) {
 						lvcd->clrText = RGB(255, 0, 0); // Red
 					}
 				}
 				else if (lvcd->iSubItem == 1) { // Priority
-					WCHAR buf[MAX_STRING] = {};
-					ListView_GetItemText(hListView, (int)lvcd->nmcd.dwItemSpec, 1, buf, MAX_STRING);
-					buf[MAX_STRING - 1] = L'\0'; // null-termination
-
-					if (wcslen(buf) == 0 || wcscmp(buf, DEFAULT_TEXT) == 0) {
-						lvcd->clrText = RGB(0, 0, 0); // Black
-					}
-					else if (wcscmp(buf, L"Realtime") == 0) {
-						lvcd->clrText = RGB(139, 0, 0); // Dark Red
-					}
-					else if (wcscmp(buf, L"High") == 0) {
-						lvcd->clrText = RGB(205, 92, 0); // Dark Orange
-					}
-					else if (wcscmp(buf, L"Above Normal") == 0) {
-						lvcd->clrText = RGB(218, 165, 32); // Gold
-					}
-					else if (wcscmp(buf, L"Normal") == 0) {
-						lvcd->clrText = RGB(0, 100, 0); // Dark Green
-					}
-					else if (wcscmp(buf, L"Below Normal") == 0) {
-						lvcd->clrText = RGB(0, 139, 139); // Dark Cyan
-					}
-					else if (wcscmp(buf, L"Idle") == 0) {
-						lvcd->clrText = RGB(105, 105, 105); // Dim Gray
+					switch (app->hasPriority ? app->priority : 0) {
+					case 4: lvcd->clrText = RGB(139, 0, 0); break;     // Realtime, Dark Red
+					case 3: lvcd->clrText = RGB(205, 92, 0); break;    // High, Dark Orange
+					case 6: lvcd->clrText = RGB(218, 165, 32); break;  // Above Normal, Gold
+					case 2: lvcd->clrText = RGB(0, 100, 0); break;     // Normal, Dark Green
+					case 5: lvcd->clrText = RGB(0, 139, 139); break;   // Below Normal, Dark Cyan
+					case 1: lvcd->clrText = RGB(105, 105, 105); break; // Idle, Dim Gray
+					default: lvcd->clrText = RGB(0, 0, 0); break;      // Default / unknown, Black
 					}
 				}
+				else {
+					lvcd->clrText = RGB(0, 0, 0); // don't inherit the Priority color
+				}
 				return CDRF_DODEFAULT;
 			}
 			}
@@ -640,7 +1117,18 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 	}
 	break;
 
+	case WM_STORE_CHANGED:
+		StartScan(false, true);
+		break;
+
+	case WM_SCAN_BATCH:
+		OnScanBatch((ScanBatch*)lParam);
+		break;
+
 	case WM_DESTROY:
+		Watcher.Stop();
+		StopScan();
+		DropScanBatches(hWnd);
 		PostQuitMessage(0);
 		break;
 	default:
@@ -682,6 +1170,7 @@ INT_PTR CALLBACK AddDlg(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
 		appPathPtr = (std::wstring*)lParam;
 
 		PriorityList(hDlg);
+		ShowLevels(hDlg, AppRecord{});
 		CenterWindow(hDlg);
 		return (INT_PTR)TRUE;
 	}
@@ -720,34 +1209,36 @@ INT_PTR CALLBACK AddDlg(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
 			}
 
 			// Check if app already exists in the ListView
-			bool alreadyExists = false;
-			if (hListView) {
-				int itemCount = ListView_GetItemCount(hListView);
-				for (int i = 0; i < itemCount; ++i) {
-					WCHAR buf[MAX_STRING];
-					ListView_GetItemText(hListView, i, 0, buf, 256);
-					buf[MAX_STRING - 1] = L'\0'; // null-termination
-
-					if (_wcsicmp(buf, appPath) == 0) {
-						alreadyExists = true;
-						break;
-					}
-				}
-			}
-			if (alreadyExists) {
+			const AppRecord* existing = FindApp(appPath);
+			if (existing && IsVisible(*existing)) {
 				std::wstring msg = L"Application \"" + std::wstring(appPath) + L"\" already exists.";
 				MessageBoxW(hDlg, msg.c_str(), L"Warning", MB_ICONWARNING);
 				break;
 			}
 
+			std::wstring cpuSet;
+			int numaNode;
+			if (!ReadPlacement(hDlg, cpuSet, numaNode))
+				break;
+
 			*appPathPtr = appPath;
 
-			// Set the SetPriorityManaged by default
-			DefaultPriority(*appPathPtr);
+			// Set the SetPriorityManaged by default; key and values land in one commit
+			WriteBatch batch;
+			batch.DefaultPriority(*appPathPtr);
+			batch.SetIoPriority(*appPathPtr, SelectedLevel(hDlg, IDC_IO_COMBO));
+			batch.SetPagePriority(*appPathPtr, SelectedLevel(hDlg, IDC_PAGE_COMBO));
+			batch.SetCpuSet(*appPathPtr, cpuSet);
+			batch.SetNumaNode(*appPathPtr, numaNode);
 
 			int index = (int)SendDlgItemMessageW(hDlg, IDC_PRIORITY_COMBO, CB_GETCURSEL, 0, 0);
 			if (index > 0 && index < std::size(PriorityValues)) {
-				SetPriority(*appPathPtr, PriorityValues[index]);
+				batch.SetPriority(*appPathPtr, PriorityValues[index]);
+			}
+
+			if (!Store->Commit(batch)) {
+				MessageBoxW(hDlg, L"Failed to write the registry. Nothing was changed.", L"Error", MB_ICONERROR);
+				break;
 			}
 
 			EndDialog(hDlg, IDOK);
@@ -765,22 +1256,21 @@ INT_PTR CALLBACK AddDlg(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
 
 INT_PTR CALLBACK EditDlg(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
 {
-	static std::wstring* appNamePtr = nullptr;
+	static AppRecord* appPtr = nullptr;
 
 	switch (message)
 	{
 	case WM_INITDIALOG:
 	{
-		appNamePtr = (std::wstring*)lParam;
-		SetDlgItemTextW(hDlg, IDC_EDIT_APPNAME, appNamePtr->c_str());
+		appPtr = (AppRecord*)lParam;
+		SetDlgItemTextW(hDlg, IDC_EDIT_APPNAME, appPtr->name.c_str());
 
 		PriorityList(hDlg);
 
-		DWORD currentPriority = 0;
-		if (GetPriority(*appNamePtr, currentPriority)) {
+		if (appPtr->hasPriority) {
 			int selIndex = 0;
 			for (int i = 0; i < std::size(PriorityValues); ++i) {
-				if (PriorityValues[i] == currentPriority) {
+				if (PriorityValues[i] == appPtr->priority) {
 					selIndex = i;
 					break;
 				}
@@ -791,7 +1281,10 @@ INT_PTR CALLBACK EditDlg(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
 			SendDlgItemMessageW(hDlg, IDC_PRIORITY_COMBO, CB_SETCURSEL, 0, 0); // Default
 		}
 
-		if (IsSetPriorityApp(*appNamePtr)) { // check if app is managed by SetPriority
+		ShowLevels(hDlg, *appPtr);
+		ShowPlacement(hDlg, *appPtr);
+
+		if (appPtr->managed) { // check if app is managed by SetPriority
 			EnableWindow(GetDlgItem(hDlg, IDC_UNMANAGED), TRUE);
 		}
 		else {
@@ -807,26 +1300,44 @@ INT_PTR CALLBACK EditDlg(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
 		{
 		case IDOK:
 		{
+			std::wstring cpuSet;
+			int numaNode;
+			if (!ReadPlacement(hDlg, cpuSet, numaNode))
+				return (INT_PTR)TRUE;
+
+			WriteBatch batch;
 			int index = (int)SendDlgItemMessageW(hDlg, IDC_PRIORITY_COMBO, CB_GETCURSEL, 0, 0);
 			if (index > 0 && index < std::size(PriorityValues)) {
-				SetPriority(*appNamePtr, PriorityValues[index]);
+				batch.SetPriority(appPtr->name, PriorityValues[index]);
 			}
 			else if (index == 0) {
-				std::wstring perfKey = GetRegPath(*appNamePtr);
-				HKEY hKey;
-				if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, perfKey.c_str(), 0, KEY_SET_VALUE, &hKey) == ERROR_SUCCESS) {
-					RegDeleteValueW(hKey, RegPriority); // Only remove priority value
-					RegCloseKey(hKey);
-				}
+				batch.ClearPriority(appPtr->name); // Only remove priority value
+			}
+			// only what the user changed: a value the combo cannot show stays as it is
+			int io = SelectedLevel(hDlg, IDC_IO_COMBO), page = SelectedLevel(hDlg, IDC_PAGE_COMBO);
+			int shownIo = appPtr->hasIoPriority && appPtr->ioPriority < std::size(IoPriorityNames) ? (int)appPtr->ioPriority : -1;
+			int shownPage = appPtr->hasPagePriority && appPtr->pagePriority < std::size(PagePriorityNames) ? (int)appPtr->pagePriority : -1;
+			if (io != shownIo)
+				batch.SetIoPriority(appPtr->name, io);
+			if (page != shownPage)
+				batch.SetPagePriority(appPtr->name, page);
+			if (cpuSet != appPtr->cpuSet)
+				batch.SetCpuSet(appPtr->name, cpuSet);
+			if (numaNode != appPtr->numaNode)
+				batch.SetNumaNode(appPtr->name, numaNode);
+
+			if (!Store->Commit(batch)) {
+				MessageBoxW(hDlg, L"Failed to write the registry. Nothing was changed.", L"Error", MB_ICONERROR);
+				return (INT_PTR)TRUE;
 			}
 
 			DWORD priority = 0;
 			std::wstring priorityName = DEFAULT_TEXT;
-			if (GetPriority(*appNamePtr, priority)) {
+			if (Store->GetPriority(appPtr->name, priority)) {
 				priorityName = ConvertHexToName(priority);
 			}
 
-			std::wstring status = L"Changed app \"" + *appNamePtr + L"\" and set priority to " + priorityName;
+			std::wstring status = L"Changed app \"" + appPtr->name + L"\" and set priority to " + priorityName;
 			SetStatus(status);
 
 			EndDialog(hDlg, IDOK);
@@ -834,8 +1345,8 @@ INT_PTR CALLBACK EditDlg(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
 		}
 
 		case IDC_DELETE:
-			if (appNamePtr) {
-				if (!CheckSystemApp(hDlg, *appNamePtr)) {
+			if (appPtr) {
+				if (!CheckSystemApp(hDlg, appPtr->name)) {
 					return (INT_PTR)TRUE;
 				}
 
@@ -850,17 +1361,12 @@ INT_PTR CALLBACK EditDlg(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
 
 		case IDC_UNMANAGED:
 		{
-			if (appNamePtr) {
-				std::wstring msg = L"This app will now unmanaged\nUnmanaged \"" + *appNamePtr + L"\"?";
+			if (appPtr) {
+				std::wstring msg = L"This app will now unmanaged\nUnmanaged \"" + appPtr->name + L"\"?";
 				if (MessageBoxW(hDlg, msg.c_str(), L"Confirm", MB_OKCANCEL | MB_ICONQUESTION) == IDOK) {
-					std::wstring perfKey = GetRegPath(*appNamePtr);
-					HKEY hKey;
-					if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, perfKey.c_str(), 0, KEY_SET_VALUE, &hKey) == ERROR_SUCCESS) {
-						RegDeleteValueW(hKey, RegManaged);
-						RegCloseKey(hKey);
-					}
+					Store->Unmanage(appPtr->name);
 
-					std::wstring status = L"Unmanaged \"" + *appNamePtr + L"\"";
+					std::wstring status = L"Unmanaged \"" + appPtr->name + L"\"";
 					SetStatus(status);
 
 					EndDialog(hDlg, 1001); // custom code for unmanaged
@@ -0,0 +1,46 @@
+#include "mappedfile.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+#ifdef _WIN32
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return;
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 && (uint64_t)fileSize.QuadPart <= SIZE_MAX) {
+		HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) {
+			data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (data) size = (size_t)fileSize.QuadPart;
+			CloseHandle(mapping); // the view keeps it alive
+		}
+	}
+	CloseHandle(file);
+#else
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return;
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size > 0) {
+		void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view != MAP_FAILED) {
+			data = (const char*)view;
+			size = (size_t)info.st_size;
+		}
+	}
+	close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+	if (!data) return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void*)data, size);
+#endif
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "platform.h"
+#include <cstddef>
+#include <filesystem>
+
+// Read-only view of a whole file (mmap / MapViewOfFile); empty when it cannot be mapped,
+// including when the file is empty
+class MappedFile {
+public:
+	explicit MappedFile(const std::filesystem::path& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* data = nullptr;
+	size_t size = 0;
+};
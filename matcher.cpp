@@ -0,0 +1,169 @@
+#include "matcher.h"
+#include <algorithm>
+
+// Past this many DFA states the cache starts over; enough for any realistic rule set, and
+// it bounds memory (about 1 KiB a state) for adversarial ones
+constexpr size_t MAX_STATES = 4096;
+
+static uint8_t Fold(char c, bool fold) {
+	return fold && c >= 'A' && c <= 'Z' ? uint8_t(c - 'A' + 'a') : uint8_t(c);
+}
+
+// FNV-1a over the folded bytes
+static uint64_t HashFolded(std::string_view name, bool fold) {
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : name) {
+		hash ^= Fold(c, fold);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static bool EqualFolded(const std::string& folded, std::string_view name, bool fold) {
+	if (folded.size() != name.size()) return false;
+	for (size_t i = 0; i < name.size(); ++i) {
+		if (uint8_t(folded[i]) != Fold(name[i], fold)) return false;
+	}
+	return true;
+}
+
+bool NameMatcher::IsPattern(std::string_view name) {
+	return name.find_first_of("*?") != std::string_view::npos;
+}
+
+void NameMatcher::Clear() {
+	exact.clear();
+	slots.clear();
+	program.clear();
+	starts.clear();
+	patterns.clear();
+	states.clear();
+	known.clear();
+}
+
+void NameMatcher::Add(std::string_view name, uint32_t id) {
+	if (!IsPattern(name)) {
+		std::string folded(name.size(), '\0');
+		std::transform(name.begin(), name.end(), folded.begin(), [this](char c) { return char(Fold(c, foldCase)); });
+		exact.emplace_back(std::move(folded), id);
+		return;
+	}
+
+	Pattern pattern{ id, 0 };
+	starts.push_back((uint32_t)program.size());
+	for (char c : name) {
+		if (c == '*') {
+			if (program.size() == starts.back() || program.back().kind != AnyRun)
+				program.push_back({ AnyRun, 0, 0 });
+		}
+		else if (c == '?') {
+			program.push_back({ AnyOne, 0, 0 });
+		}
+		else {
+			program.push_back({ Literal, Fold(c, foldCase), 0 });
+			++pattern.literals;
+		}
+	}
+	program.push_back({ End, 0, (uint32_t)patterns.size() });
+	patterns.push_back(pattern);
+}
+
+void NameMatcher::Compile() {
+	// load factor at most one half, so a miss ends after a probe or two
+	size_t size = 16;
+	while (size < exact.size() * 2) size *= 2;
+	slots.assign(size, NONE);
+	for (uint32_t index = 0; index < exact.size(); ++index) {
+		size_t slot = HashFolded(exact[index].first, foldCase) & (size - 1);
+		while (slots[slot] != NONE && exact[slots[slot]].first != exact[index].first)
+			slot = (slot + 1) & (size - 1);
+		if (slots[slot] == NONE) slots[slot] = index; // the first of equal names wins
+	}
+	ResetStates();
+}
+
+void NameMatcher::ResetStates() const {
+	states.clear();
+	known.clear();
+	std::vector<uint32_t> positions;
+	AddState(positions);
+	positions = starts;
+	AddState(positions);
+}
+
+// Add what '*' can skip to: a run matches empty, so the token after it is live too
+void NameMatcher::Close(std::vector<uint32_t>& positions) const {
+	for (size_t i = 0; i < positions.size(); ++i) {
+		if (program[positions[i]].kind == AnyRun)
+			positions.push_back(positions[i] + 1);
+	}
+	std::sort(positions.begin(), positions.end());
+	positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+}
+
+int32_t NameMatcher::AddState(std::vector<uint32_t>& positions) const {
+	Close(positions);
+	auto found = known.find(positions);
+	if (found != known.end()) return found->second;
+
+	State state;
+	state.positions = positions;
+	std::fill(std::begin(state.next), std::end(state.next), -1);
+	for (uint32_t position : positions) {
+		if (program[position].kind != End) continue;
+		uint32_t candidate = program[position].pattern;
+		if (state.accept == NONE || patterns[candidate].literals > patterns[state.accept].literals ||
+			(patterns[candidate].literals == patterns[state.accept].literals && patterns[candidate].id < patterns[state.accept].id))
+			state.accept = candidate;
+	}
+
+	int32_t index = (int32_t)states.size();
+	states.push_back(std::move(state));
+	known.emplace(positions, index);
+	return index;
+}
+
+int32_t NameMatcher::Step(int32_t from, uint8_t byte) const {
+	int32_t cached = states[from].next[byte];
+	if (cached >= 0) return cached;
+
+	scratch.clear();
+	for (uint32_t position : states[from].positions) {
+		const Token& token = program[position];
+		if (token.kind == AnyRun) scratch.push_back(position);
+		else if (token.kind == AnyOne || (token.kind == Literal && token.byte == byte)) scratch.push_back(position + 1);
+	}
+
+	Close(scratch);
+	auto found = known.find(scratch);
+	if (found == known.end() && states.size() >= MAX_STATES) {
+		ResetStates(); // from is gone; the target below is all the walk needs
+		return AddState(scratch);
+	}
+	int32_t to = found != known.end() ? found->second : AddState(scratch);
+	states[from].next[byte] = to;
+	return to;
+}
+
+uint32_t NameMatcher::Lookup(std::string_view name) const {
+	if (exact.empty() || slots.empty()) return NONE;
+	size_t mask = slots.size() - 1;
+	for (size_t slot = HashFolded(name, foldCase) & mask; slots[slot] != NONE; slot = (slot + 1) & mask) {
+		if (EqualFolded(exact[slots[slot]].first, name, foldCase))
+			return exact[slots[slot]].second;
+	}
+	return NONE;
+}
+
+uint32_t NameMatcher::Match(std::string_view name) const {
+	uint32_t id = Lookup(name);
+	if (id != NONE || patterns.empty()) return id;
+
+	int32_t state = 1;
+	for (char c : name) {
+		state = Step(state, Fold(c, foldCase));
+		if (state == 0) return NONE; // dead: no pattern can match any more
+	}
+	uint32_t accept = states[state].accept;
+	return accept == NONE ? NONE : patterns[accept].id;
+}
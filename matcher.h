@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Rule names to ids, in time independent of how many rules there are. ASCII case is folded
+// on both sides, unless the matcher is made with foldCase false (Linux paths).
+// - exact names go into an open-addressing hash table
+// - patterns ('*' any run, '?' any one byte) are compiled together into one DFA, built
+//   lazily: a state is made the first time a name walks into it, so thousands of patterns
+//   cost nothing up front, and a name is matched in one table step per byte afterwards
+// An exact name beats any pattern; among patterns the one with the most literal bytes wins,
+// then the lowest id.
+// Match is const but fills the DFA cache, so one matcher is not for concurrent use.
+class NameMatcher {
+public:
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	explicit NameMatcher(bool foldCase = true) : foldCase(foldCase) {}
+
+	void Clear();
+	void Add(std::string_view name, uint32_t id); // a pattern when it holds '*' or '?'
+	void Compile();                               // after the last Add
+
+	uint32_t Match(std::string_view name) const;  // NONE when nothing matches; no allocation once warm
+	bool Empty() const { return exact.empty() && patterns.empty(); }
+	bool HasPatterns() const { return !patterns.empty(); }
+
+	static bool IsPattern(std::string_view name);
+
+private:
+	// pattern program: one token per byte of the pattern, '*' runs collapsed, plus an
+	// END token per pattern
+	enum TokenKind : uint8_t { Literal, AnyOne, AnyRun, End };
+	struct Token {
+		TokenKind kind;
+		uint8_t byte;      // Literal
+		uint32_t pattern;  // End: index into patterns
+	};
+	struct Pattern {
+		uint32_t id;
+		uint32_t literals; // specificity
+	};
+	struct State {
+		std::vector<uint32_t> positions; // sorted token indices
+		uint32_t accept = NONE;          // best pattern index accepted here
+		int32_t next[256];               // -1: not computed yet
+	};
+
+	uint32_t Lookup(std::string_view name) const;
+	int32_t Step(int32_t state, uint8_t byte) const;
+	int32_t AddState(std::vector<uint32_t>& positions) const;
+	void Close(std::vector<uint32_t>& positions) const;
+	void ResetStates() const;
+
+	bool foldCase;
+	std::vector<std::pair<std::string, uint32_t>> exact; // folded name, id
+	std::vector<uint32_t> slots;                         // into exact; NONE: empty
+	std::vector<Token> program;
+	std::vector<uint32_t> starts;                        // first token of every pattern
+	std::vector<Pattern> patterns;
+
+	mutable std::vector<State> states;                   // 0: dead, 1: start
+	mutable std::map<std::vector<uint32_t>, int32_t> known; // positions to state
+	mutable std::vector<uint32_t> scratch;
+};
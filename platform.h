@@ -0,0 +1,23 @@
+#pragma once
+
+// Shared by the files that also build outside Windows (store, backends, command line).
+// The GUI keeps using pch.h / framework.h directly.
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cstdint>
+#include <cwchar>
+#include <cwctype>
+typedef uint32_t DWORD;
+#define _wcsicmp wcscasecmp
+#define _wcsnicmp wcsncasecmp
+#endif
+
+#include <string>
+
+std::string WideToUtf8(const std::wstring& text);
+std::wstring Utf8ToWide(const std::string& text);
+std::wstring FoldCase(const std::wstring& text); // lower-case copy for case-insensitive keys
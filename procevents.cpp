@@ -0,0 +1,177 @@
+#ifndef _WIN32
+#include "procevents.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// proc_event's event codes; older headers nest the enum inside the struct, newer ones do not
+constexpr unsigned EVENT_FORK = 0x00000001;
+constexpr unsigned EVENT_EXEC = 0x00000002;
+constexpr unsigned EVENT_COMM = 0x00000200;
+
+uint64_t MonotonicNs() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return uint64_t(now.tv_sec) * 1000000000ull + uint64_t(now.tv_nsec);
+}
+
+static bool SendListen(int sock, proc_cn_mcast_op op) {
+	alignas(nlmsghdr) char buffer[NLMSG_SPACE(sizeof(cn_msg) + sizeof(proc_cn_mcast_op))] = {};
+	nlmsghdr* header = reinterpret_cast<nlmsghdr*>(buffer);
+	header->nlmsg_len = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(op));
+	header->nlmsg_type = NLMSG_DONE;
+	header->nlmsg_pid = getpid();
+
+	cn_msg* message = static_cast<cn_msg*>(NLMSG_DATA(header));
+	message->id.idx = CN_IDX_PROC;
+	message->id.val = CN_VAL_PROC;
+	message->len = sizeof(op);
+	memcpy(message->data, &op, sizeof(op));
+
+	return send(sock, buffer, header->nlmsg_len, 0) == (ssize_t)header->nlmsg_len;
+}
+
+bool ProcessEvents::Open() {
+	Close();
+	sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+	if (sock < 0) return false;
+
+	// a bigger receive buffer rides out fork storms without ENOBUFS
+	int size = 4 << 20;
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	sockaddr_nl address{};
+	address.nl_family = AF_NETLINK;
+	address.nl_groups = CN_IDX_PROC;
+	address.nl_pid = 0; // let the kernel pick
+	if (bind(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || !SendListen(sock, PROC_CN_MCAST_LISTEN)) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void ProcessEvents::Close() {
+	if (sock < 0) return;
+	SendListen(sock, PROC_CN_MCAST_IGNORE);
+	close(sock);
+	sock = -1;
+}
+
+bool ProcessEvents::Poll(int timeoutMs, const ProcEventHandler& onEvent, bool& overrun) {
+	overrun = false;
+	pollfd waitFor{ sock, POLLIN, 0 };
+	int ready = poll(&waitFor, 1, timeoutMs);
+	if (ready < 0) return errno == EINTR;
+	if (ready == 0) return true;
+
+	alignas(nlmsghdr) char buffer[8192];
+	while (true) {
+		ssize_t length = recv(sock, buffer, sizeof(buffer), MSG_DONTWAIT);
+		if (length < 0) {
+			if (errno == EAGAIN || errno == EINTR) return true;
+			if (errno == ENOBUFS) { overrun = true; continue; }
+			return false;
+		}
+
+		for (nlmsghdr* header = reinterpret_cast<nlmsghdr*>(buffer); NLMSG_OK(header, (unsigned)length); header = NLMSG_NEXT(header, length)) {
+			if (header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_NOOP) continue;
+
+			const cn_msg* message = static_cast<const cn_msg*>(NLMSG_DATA(header));
+			if (message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC) continue;
+
+			const proc_event* event = reinterpret_cast<const proc_event*>(message->data);
+			switch ((unsigned)event->what)
+			{
+			case EVENT_EXEC:
+				onEvent({ ProcEvent::Exec, event->event_data.exec.process_tgid, event->event_data.exec.process_pid, event->timestamp_ns });
+				break;
+			case EVENT_FORK:
+				onEvent({ ProcEvent::Fork, event->event_data.fork.child_tgid, event->event_data.fork.child_pid, event->timestamp_ns });
+				break;
+			case EVENT_COMM:
+				onEvent({ ProcEvent::Comm, event->event_data.comm.process_tgid, event->event_data.comm.process_pid, event->timestamp_ns });
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+// Process start time from /proc/<pid>/stat, on the CLOCK_MONOTONIC scale; 0 if it is gone
+static uint64_t StartTimeNs(int pid, uint64_t monotonicNow, uint64_t bootNow) {
+	char path[32], stat[512];
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return 0;
+	ssize_t length = read(fd, stat, sizeof(stat) - 1);
+	close(fd);
+	if (length <= 0) return 0;
+	stat[length] = '\0';
+
+	// comm may hold spaces and parentheses; the fields we want start after the last ')'
+	const char* field = strrchr(stat, ')');
+	if (!field) return 0;
+	for (int i = 2; i < 22 && field; ++i) // starttime is field 22
+		field = strchr(field + 1, ' ');
+	if (!field) return 0;
+
+	static const uint64_t ticks = (uint64_t)sysconf(_SC_CLK_TCK);
+	uint64_t sinceBootNs = strtoull(field + 1, nullptr, 10) * (1000000000ull / ticks);
+	uint64_t ageNs = bootNow > sinceBootNs ? bootNow - sinceBootNs : 0;
+	return monotonicNow > ageNs ? monotonicNow - ageNs : monotonicNow;
+}
+
+void ProcessPoller::Poll(const ProcEventHandler& onEvent) {
+	current.clear();
+	DIR* proc = opendir("/proc");
+	if (!proc) return;
+	while (dirent* entry = readdir(proc)) {
+		if (entry->d_name[0] >= '1' && entry->d_name[0] <= '9')
+			current.push_back(atoi(entry->d_name));
+	}
+	closedir(proc);
+	std::sort(current.begin(), current.end());
+
+	if (seeded) {
+		timespec boot;
+		clock_gettime(CLOCK_BOOTTIME, &boot);
+		uint64_t bootNow = uint64_t(boot.tv_sec) * 1000000000ull + uint64_t(boot.tv_nsec);
+		uint64_t monotonicNow = MonotonicNs();
+
+		auto old = known.begin();
+		for (int pid : current) {
+			while (old != known.end() && *old < pid) ++old;
+			if (old != known.end() && *old == pid) continue;
+
+			uint64_t started = StartTimeNs(pid, monotonicNow, bootNow);
+			if (started) onEvent({ ProcEvent::Exec, pid, pid, started });
+		}
+	}
+	known.swap(current);
+	seeded = true;
+}
+
+uint64_t LatencyStats::Percentile(double p) {
+	if (samples.empty()) return 0;
+	size_t rank = std::min(samples.size() - 1, size_t(p * (samples.size() - 1) + 0.5));
+	std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+	return samples[rank];
+}
+
+uint64_t LatencyStats::Max() {
+	return samples.empty() ? 0 : *std::max_element(samples.begin(), samples.end());
+}
+#endif
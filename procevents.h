@@ -0,0 +1,66 @@
+#pragma once
+
+// Process start notification for the Linux enforcer. The netlink proc connector reports
+// every exec and fork as it happens, and every thread that renames itself (which is when
+// thread rules can first match it: threads are named after they start); without it (no CAP_NET_ADMIN, kernel built without
+// CONFIG_PROC_EVENTS) we fall back to diffing the PID list in /proc.
+#ifndef _WIN32
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct ProcEvent {
+	enum Kind { Exec, Fork, Comm } kind;
+	int pid;                // thread group (process) id
+	int tid;                // the thread that exec'd, the new thread for Fork, the renamed one for Comm
+	uint64_t timestampNs;   // CLOCK_MONOTONIC when it happened
+};
+
+typedef std::function<void(const ProcEvent&)> ProcEventHandler;
+
+uint64_t MonotonicNs();
+
+class ProcessEvents {
+public:
+	ProcessEvents() = default;
+	ProcessEvents(const ProcessEvents&) = delete;
+	ProcessEvents& operator=(const ProcessEvents&) = delete;
+	~ProcessEvents() { Close(); }
+
+	bool Open(); // subscribe to the proc connector; false when it is unavailable
+	void Close();
+	bool IsOpen() const { return sock >= 0; }
+
+	// Wait up to timeoutMs and hand every event received to onEvent. Returns false on a
+	// socket error; overrun is set when the kernel dropped events because we fell behind.
+	bool Poll(int timeoutMs, const ProcEventHandler& onEvent, bool& overrun);
+
+private:
+	int sock = -1;
+};
+
+// Fallback: new PIDs since the previous call, timed from their start time in /proc/<pid>/stat.
+// Cannot see an exec that keeps its PID; the periodic full sweep picks those up.
+class ProcessPoller {
+public:
+	void Poll(const ProcEventHandler& onEvent);
+
+private:
+	std::vector<int> known; // sorted
+	std::vector<int> current;
+	bool seeded = false;
+};
+
+// Exec-to-applied latency samples between two reports
+class LatencyStats {
+public:
+	void Add(uint64_t ns) { samples.push_back(ns); }
+	size_t Count() const { return samples.size(); }
+	uint64_t Percentile(double p); // ns; reorders the samples
+	uint64_t Max();
+	void Clear() { samples.clear(); }
+
+private:
+	std::vector<uint64_t> samples;
+};
+#endif
@@ -0,0 +1,134 @@
+#include "profiles.h"
+#include "rules.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cwchar>
+#include <fstream>
+#include <unordered_map>
+
+std::filesystem::path DefaultProfileDirectory() {
+#ifdef _WIN32
+	if (const wchar_t* roaming = _wgetenv(L"APPDATA"))
+		return std::filesystem::path(roaming) / L"SetPriority" / L"profiles";
+	return std::filesystem::path(L"profiles");
+#else
+	if (const char* config = getenv("XDG_CONFIG_HOME"); config && *config)
+		return std::filesystem::path(config) / "setpriority" / "profiles";
+	if (const char* home = getenv("HOME"); home && *home)
+		return std::filesystem::path(home) / ".config" / "setpriority" / "profiles";
+	return std::filesystem::path("profiles");
+#endif
+}
+
+bool IsValidProfileName(const std::wstring& name) {
+	if (name.empty() || name.size() > 100 || name == L"." || name == L"..") return false;
+	for (wchar_t c : name) {
+		if (c < 0x20 || wcschr(L"\\/:*?\"<>|", c)) return false;
+	}
+	return true;
+}
+
+std::filesystem::path ProfilePath(const std::filesystem::path& dir, const std::wstring& name) {
+	return dir / std::filesystem::path(name + L".txt");
+}
+
+std::vector<std::wstring> ListProfiles(const std::filesystem::path& dir) {
+	std::vector<std::wstring> names;
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+		const std::filesystem::path& file = entry.path();
+		if (entry.is_regular_file(ec) && _wcsicmp(file.extension().wstring().c_str(), L".txt") == 0)
+			names.push_back(file.stem().wstring());
+	}
+	std::sort(names.begin(), names.end(), NoCaseLess());
+	return names;
+}
+
+bool SaveProfile(PriorityStore& store, const std::filesystem::path& file) {
+	std::error_code ec;
+	std::filesystem::create_directories(file.parent_path(), ec);
+	std::filesystem::path temp = file;
+	temp += ".tmp";
+	{
+		std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+		if (out) ExportRules(store, out, false);
+		if (!out.flush()) return false;
+	}
+	std::filesystem::rename(temp, file, ec); // a profile being switched to is never half written
+	if (ec) std::filesystem::remove(temp, ec);
+	return !ec;
+}
+
+// Drop everything SetPriority set on an app, leaving the key and anything else in it
+static void Release(WriteBatch& batch, const std::wstring& name) {
+	batch.ClearPriority(name);
+	batch.Unmanage(name);
+	batch.SetIoPriority(name, -1);
+	batch.SetPagePriority(name, -1);
+	batch.SetCpuSet(name, L"");
+	batch.SetNumaNode(name, -1);
+	batch.SetCpuWeight(name, 0);
+	batch.SetCpuQuota(name, 0);
+	batch.SetPriorityBounds(name, 0, 0);
+	batch.SetThreadRules(name, L"");
+}
+
+ProfileSwitch PlanProfileSwitch(const std::vector<AppRecord>& current, const std::vector<AppRecord>& profile,
+	WriteBatch& batch) {
+	TRACE_SCOPE("profiles", "PlanProfileSwitch");
+	std::unordered_map<std::wstring, const AppRecord*> wanted; // the last rule for an app wins
+	wanted.reserve(profile.size());
+	for (const auto& rule : profile)
+		wanted[FoldCase(rule.name)] = &rule;
+
+	std::unordered_map<std::wstring, const AppRecord*> have;
+	have.reserve(current.size());
+	for (const auto& app : current)
+		have.emplace(FoldCase(app.name), &app);
+
+	ProfileSwitch plan;
+	for (const auto& rule : profile) {
+		std::wstring key = FoldCase(rule.name);
+		if (wanted[key] != &rule) continue; // overridden further down
+
+		auto found = have.find(key);
+		const AppRecord* app = found == have.end() ? nullptr : found->second;
+		if (app && SameSettings(*app, rule)) {
+			++plan.unchanged;
+			continue;
+		}
+		ApplyRule(batch, rule);
+		if (app && app->perfOptions) ++plan.changed;
+		else ++plan.added;
+	}
+
+	for (const auto& app : current) {
+		if (app.perfOptions && app.managed && !wanted.count(FoldCase(app.name))) {
+			Release(batch, app.name);
+			++plan.released;
+		}
+	}
+	return plan;
+}
+
+ProfileSwitch SwitchProfile(PriorityStore& store, std::istream& profile,
+	const std::function<void(size_t, const std::wstring&)>& onError) {
+	TRACE_SCOPE("profiles", "SwitchProfile");
+	ProfileSwitch result;
+	std::vector<AppRecord> rules;
+	ReadRuleLines(profile, [&](size_t lineNo, const std::wstring& text, const AppRecord* rule) {
+		if (rule) {
+			rules.push_back(*rule);
+			return;
+		}
+		++result.failed;
+		if (onError) onError(lineNo, text);
+	});
+	if (result.failed) return result; // half a profile is no profile
+
+	WriteBatch batch;
+	result = PlanProfileSwitch(store.LoadSnapshot(), rules, batch);
+	result.committed = batch.Empty() || store.Commit(batch);
+	return result;
+}
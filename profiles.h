@@ -0,0 +1,43 @@
+#pragma once
+
+#include "store.h"
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+// Named rule sets ("interactive", "render farm", "overnight build"), each a rule file in one
+// directory. Switching to a profile diffs it against the store and writes only the keys
+// whose settings differ, in one all-or-nothing batch:
+// - a rule whose key already holds exactly its settings is left alone
+// - any other rule is applied as --import would
+// - a managed app the profile does not list is released: SetPriority's values are cleared
+//   and it is unmanaged, the key itself stays
+
+struct ProfileSwitch {
+	size_t added = 0;     // rules for keys without PerfOptions
+	size_t changed = 0;   // rules for keys that held other settings
+	size_t released = 0;  // managed apps the profile leaves out
+	size_t unchanged = 0;
+	size_t failed = 0;    // lines that did not parse; any of them cancels the switch
+	bool committed = false;
+
+	size_t Writes() const { return added + changed + released; }
+};
+
+std::filesystem::path DefaultProfileDirectory(); // %APPDATA%\SetPriority\profiles, ~/.config/setpriority/profiles
+bool IsValidProfileName(const std::wstring& name); // usable as a file name, no path
+std::filesystem::path ProfilePath(const std::filesystem::path& dir, const std::wstring& name); // dir/name.txt
+std::vector<std::wstring> ListProfiles(const std::filesystem::path& dir); // sorted
+
+// The store's managed apps as a profile; false when the file cannot be written
+bool SaveProfile(PriorityStore& store, const std::filesystem::path& file);
+
+// What turns current (a store snapshot) into profile, queued on batch
+ProfileSwitch PlanProfileSwitch(const std::vector<AppRecord>& current, const std::vector<AppRecord>& profile,
+	WriteBatch& batch);
+
+// onError gets the line number and text of every line that did not parse
+ProfileSwitch SwitchProfile(PriorityStore& store, std::istream& profile,
+	const std::function<void(size_t, const std::wstring&)>& onError = nullptr);
@@ -0,0 +1,328 @@
+#include "regfile.h"
+#include "mappedfile.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REGFILE_SSE2 1
+#endif
+
+constexpr size_t BLOCK_UNITS = 1 << 16; // UTF-16 code units narrowed at a time
+constexpr std::string_view IfeoKey = "\\Image File Execution Options\\";
+
+static char FoldAscii(char c) {
+	return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+}
+
+static bool EqualNoCase(std::string_view a, std::string_view b) {
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); ++i) {
+		if (FoldAscii(a[i]) != FoldAscii(b[i])) return false;
+	}
+	return true;
+}
+
+// against the value-name constants in store.h, which are ASCII
+static bool EqualNoCase(std::string_view a, const wchar_t* b) {
+	size_t i = 0;
+	for (; i < a.size() && b[i]; ++i) {
+		if (b[i] > 0x7F || FoldAscii(a[i]) != FoldAscii((char)b[i])) return false;
+	}
+	return i == a.size() && !b[i];
+}
+
+static size_t FindNoCase(std::string_view text, std::string_view needle) {
+	for (size_t at = 0; at + needle.size() <= text.size(); ++at) {
+		if (EqualNoCase(text.substr(at, needle.size()), needle)) return at;
+	}
+	return std::string_view::npos;
+}
+
+static void AppendUtf8(char*& out, unsigned long c) {
+	if (c < 0x80) {
+		*out++ = char(c);
+	}
+	else if (c < 0x800) {
+		*out++ = char(0xC0 | (c >> 6));
+		*out++ = char(0x80 | (c & 0x3F));
+	}
+	else if (c < 0x10000) {
+		*out++ = char(0xE0 | (c >> 12));
+		*out++ = char(0x80 | ((c >> 6) & 0x3F));
+		*out++ = char(0x80 | (c & 0x3F));
+	}
+	else {
+		*out++ = char(0xF0 | (c >> 18));
+		*out++ = char(0x80 | ((c >> 12) & 0x3F));
+		*out++ = char(0x80 | ((c >> 6) & 0x3F));
+		*out++ = char(0x80 | (c & 0x3F));
+	}
+}
+
+// Append count UTF-16LE units from in to out as UTF-8 and return how many were used: a high
+// surrogate at the end of a block that is not the last is left for the next one. Exports
+// are nearly all ASCII, so runs of it are narrowed 8 units per step where SSE2 is there.
+static size_t NarrowUtf16(const unsigned char* in, size_t count, bool last, std::string& out) {
+	size_t start = out.size();
+	out.resize(start + count * 3); // the most one unit can become
+	char* dst = &out[start];
+
+	size_t i = 0;
+	while (i < count) {
+#ifdef REGFILE_SSE2
+		const __m128i highBits = _mm_set1_epi16((short)0xFF80);
+		while (i + 8 <= count) {
+			__m128i units = _mm_loadu_si128((const __m128i*)(in + 2 * i));
+			__m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(units, highBits), _mm_setzero_si128());
+			if (_mm_movemask_epi8(ascii) != 0xFFFF) break;
+			_mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(units, units));
+			dst += 8;
+			i += 8;
+		}
+		if (i == count) break;
+#endif
+		unsigned long c = in[2 * i] | (unsigned long)in[2 * i + 1] << 8;
+		if (c >= 0xD800 && c <= 0xDBFF) {
+			if (i + 1 == count && !last) break;
+			unsigned long low = i + 1 < count ? in[2 * i + 2] | (unsigned long)in[2 * i + 3] << 8 : 0;
+			if (low >= 0xDC00 && low <= 0xDFFF) {
+				c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+				++i;
+			}
+			else {
+				c = 0xFFFD;
+			}
+		}
+		else if (c >= 0xDC00 && c <= 0xDFFF) {
+			c = 0xFFFD;
+		}
+		AppendUtf8(dst, c);
+		++i;
+	}
+
+	out.resize(dst - out.data());
+	return i;
+}
+
+// Lines in, AppRecords out. Fed whole blocks; a line cut by a block boundary is carried.
+class RegFileParser {
+public:
+	explicit RegFileParser(size_t expectedKeys) {
+		index.reserve(expectedKeys);
+		apps.reserve(expectedKeys);
+	}
+
+	void Feed(std::string_view block) {
+		size_t begin = 0;
+		while (const char* newline = (const char*)memchr(block.data() + begin, '\n', block.size() - begin)) {
+			std::string_view line = block.substr(begin, newline - block.data() - begin);
+			if (carry.empty()) {
+				Line(line);
+			}
+			else {
+				carry += line;
+				Line(carry);
+				carry.clear();
+			}
+			begin = newline - block.data() + 1;
+		}
+		carry.append(block.data() + begin, block.size() - begin);
+	}
+
+	bool Finish(std::vector<AppRecord>& records) { // sorted by name
+		if (!carry.empty()) Line(carry);
+		carry.clear();
+		if (!valid) return false;
+
+		// in folded byte order, which is the store's order for ASCII names and much cheaper
+		// to sort by than NoCaseLess
+		std::vector<std::pair<std::string_view, size_t>> order(index.begin(), index.end());
+		std::sort(order.begin(), order.end());
+		records.clear();
+		records.reserve(order.size());
+		for (const auto& entry : order)
+			records.push_back(std::move(apps[entry.second]));
+		return true;
+	}
+
+private:
+	void Line(std::string_view line) {
+		if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+		if (first) {
+			first = false;
+			valid = line == "Windows Registry Editor Version 5.00" || line == "REGEDIT4";
+			return;
+		}
+		if (!valid || line.empty()) return;
+
+		// hex continuation lines start with blanks; comments with ';'
+		if (line[0] == '[') Key(line);
+		else if (line[0] == '"' && current != NONE && perf) Value(line);
+	}
+
+	void Key(std::string_view line) {
+		current = NONE;
+		size_t close = line.rfind(']');
+		if (close == std::string_view::npos || line[1] == '-') return; // a deletion, not data
+		std::string_view path = line.substr(1, close - 1);
+
+		// every key of an export shares one prefix; search for it only when it changes
+		if (prefix.empty() || path.size() < prefix.size() || memcmp(path.data(), prefix.data(), prefix.size()) != 0) {
+			size_t at = FindNoCase(path, IfeoKey);
+			if (at == std::string_view::npos) return;
+			prefix.assign(path.data(), at + IfeoKey.size());
+		}
+		std::string_view rest = path.substr(prefix.size());
+		size_t slash = rest.find('\\');
+		perf = slash != std::string_view::npos;
+		if (perf && !EqualNoCase(rest.substr(slash + 1), "PerfOptions")) return;
+		std::string_view name = rest.substr(0, slash);
+		if (name.empty()) return;
+		if (name == lastName) { // "<app>\PerfOptions" right after "<app>"
+			current = lastIndex;
+			if (perf) apps[current].perfOptions = true;
+			return;
+		}
+
+		std::string folded(name);
+		std::transform(folded.begin(), folded.end(), folded.begin(), FoldAscii);
+		auto found = index.find(folded);
+		if (found == index.end()) {
+			found = index.emplace(std::move(folded), apps.size()).first;
+			apps.emplace_back();
+			apps.back().name = Utf8ToWide(std::string(name));
+		}
+		current = lastIndex = found->second;
+		lastName.assign(name.data(), name.size());
+		if (perf) apps[current].perfOptions = true;
+	}
+
+	// "name" = dword:0000000a | "text" ; anything else is skipped
+	void Value(std::string_view line) {
+		std::string& name = valueName;
+		name.clear();
+		size_t i = 1;
+		if (!Quoted(line, i, name) || i >= line.size() || line[i] != '=') return;
+		std::string_view data = line.substr(i + 1);
+
+		AppRecord& app = apps[current];
+		if (data.size() > 6 && EqualNoCase(data.substr(0, 6), "dword:")) {
+			DWORD value = 0;
+			size_t digits = 0;
+			for (char c : data.substr(6)) {
+				c = FoldAscii(c);
+				if (c >= '0' && c <= '9') value = value << 4 | DWORD(c - '0');
+				else if (c >= 'a' && c <= 'f') value = value << 4 | DWORD(c - 'a' + 10);
+				else return;
+				if (++digits > 8) return;
+			}
+
+			if (EqualNoCase(name, RegPriority)) { app.hasPriority = true; app.priority = value; }
+			else if (EqualNoCase(name, RegManaged)) app.managed = value == 1;
+			else if (EqualNoCase(name, RegIoPriority)) { app.hasIoPriority = true; app.ioPriority = value; }
+			else if (EqualNoCase(name, RegPagePriority)) { app.hasPagePriority = true; app.pagePriority = value; }
+			else if (EqualNoCase(name, RegNumaNode)) app.numaNode = (int)value;
+			else if (EqualNoCase(name, RegCpuWeight)) app.cpuWeight = value;
+			else if (EqualNoCase(name, RegCpuQuota)) app.cpuQuota = value;
+			else if (EqualNoCase(name, RegMinPriority)) app.minPriority = value;
+			else if (EqualNoCase(name, RegMaxPriority)) app.maxPriority = value;
+		}
+		else if (!data.empty() && data[0] == '"' && (EqualNoCase(name, RegCpuSet) || EqualNoCase(name, RegThreadRules))) {
+			std::string& text = valueText;
+			text.clear();
+			i = 1;
+			if (!Quoted(data, i, text)) return;
+			if (EqualNoCase(name, RegCpuSet)) NormalizeCpuList(Utf8ToWide(text), app.cpuSet);
+			else NormalizeThreadRules(Utf8ToWide(text), app.threadRules);
+		}
+	}
+
+	// text[i] is just past an opening quote; leave i just past the closing one
+	static bool Quoted(std::string_view text, size_t& i, std::string& out) {
+		for (; i < text.size(); ++i) {
+			if (text[i] == '"') {
+				++i;
+				return true;
+			}
+			if (text[i] == '\\' && i + 1 < text.size()) ++i; // \\ and \"
+			out += text[i];
+		}
+		return false;
+	}
+
+	static constexpr size_t NONE = SIZE_MAX;
+
+	std::string carry;
+	std::string prefix;    // "[HKEY_...\\Image File Execution Options\\" as this file spells it
+	bool first = true;
+	bool valid = false;
+	size_t current = NONE; // apps index of the key being read
+	bool perf = false;     // ...and whether it is its PerfOptions subkey
+	std::string lastName;  // as spelled in the last app key, and its apps index
+	size_t lastIndex = NONE;
+	std::string valueName, valueText; // reused, so values are parsed without allocating
+	std::vector<AppRecord> apps;
+	std::unordered_map<std::string, size_t> index; // ASCII-folded UTF-8 name to apps
+};
+
+bool RegFileStore::Load() {
+	TRACE_SCOPE("store", "RegFileStore::Load");
+	MappedFile file(path);
+	if (!file.data) return false;
+
+	RegFileParser parser(file.size / 512); // a UTF-16 key path alone is ~200 bytes
+	const unsigned char* bytes = (const unsigned char*)file.data;
+	if (file.size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) {
+		std::string block;
+		block.reserve(BLOCK_UNITS * 3);
+		size_t units = (file.size - 2) / 2;
+		for (size_t at = 0; at < units;) {
+			size_t count = std::min(BLOCK_UNITS, units - at);
+			block.clear();
+			at += NarrowUtf16(bytes + 2 + 2 * at, count, at + count == units, block);
+			parser.Feed(block);
+		}
+	}
+	else {
+		size_t bom = file.size >= 3 && memcmp(file.data, "\xEF\xBB\xBF", 3) == 0 ? 3 : 0;
+		parser.Feed(std::string_view(file.data + bom, file.size - bom));
+	}
+
+	std::vector<AppRecord> records;
+	if (!parser.Finish(records)) return false;
+
+	std::lock_guard<std::mutex> guard(lock);
+	apps.clear();
+	for (auto& record : records) {
+		std::wstring name = record.name;
+		apps.emplace_hint(apps.end(), std::move(name), std::move(record)); // O(1) while in order
+	}
+	return true;
+}
+
+bool RegFileStore::SetPriority(const std::wstring&, DWORD) {
+	return false;
+}
+
+void RegFileStore::DefaultPriority(const std::wstring&) {
+}
+
+bool RegFileStore::ClearPriority(const std::wstring&) {
+	return false;
+}
+
+bool RegFileStore::Unmanage(const std::wstring&) {
+	return false;
+}
+
+bool RegFileStore::RemoveApp(const std::wstring&) {
+	return false;
+}
+
+bool IsRegFile(const std::filesystem::path& path) {
+	return _wcsicmp(path.extension().wstring().c_str(), L".reg") == 0;
+}
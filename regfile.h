@@ -0,0 +1,33 @@
+#pragma once
+
+#include "store.h"
+#include <filesystem>
+
+// A `reg export` / regedit dump of the IFEO key as a read-only store, for auditing other
+// machines offline. The file is mapped and parsed in one streaming pass: UTF-16LE (what
+// both tools write) is narrowed block by block, pure-ASCII runs 8 code units at a time
+// with SSE2, and the lines are parsed from the narrowed block; REGEDIT4 (ANSI/UTF-8) files
+// go straight to the line parser. Only "...\Image File Execution Options\<app>" and its
+// PerfOptions subkey are read, other keys and value types are skipped.
+// Every mutation fails: edits belong on the machine the dump came from.
+class RegFileStore : public MemoryStore {
+public:
+	explicit RegFileStore(const std::filesystem::path& path) : path(path) {}
+
+	bool Load(); // false: unreadable, or not a registry export
+	const std::filesystem::path& Path() const { return path; }
+
+	bool SetPriority(const std::wstring& appName, DWORD priority) override;
+	void DefaultPriority(const std::wstring& appName) override;
+	bool ClearPriority(const std::wstring& appName) override;
+	bool Unmanage(const std::wstring& appName) override;
+	bool RemoveApp(const std::wstring& appName) override;
+
+protected:
+	bool Persist(const WriteBatch&) override { return false; }
+
+private:
+	std::filesystem::path path;
+};
+
+bool IsRegFile(const std::filesystem::path& path); // by extension: ".reg"
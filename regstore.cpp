@@ -0,0 +1,414 @@
+#ifdef _WIN32
+#include "store.h"
+#include "trace.h"
+#include <cstdio>
+#include <ktmw32.h>
+#include <winreg.h>
+
+#pragma comment(lib, "ktmw32.lib")
+
+static std::wstring GetRegPath(const std::wstring& appName) {
+	return IFEO_PATH + std::wstring(L"\\") + appName + L"\\PerfOptions";
+}
+
+static void SetPriorityManage(HKEY hKey) {
+	DWORD value = 1;
+	RegSetValueExW(hKey, RegManaged, 0, REG_DWORD,
+		reinterpret_cast<const BYTE*>(&value),
+		sizeof(DWORD)
+	);
+}
+
+static bool DeletePerfValue(const std::wstring& appName, const wchar_t* valueName) {
+	std::wstring perfKey = GetRegPath(appName);
+	HKEY hKey;
+	if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, perfKey.c_str(), 0, KEY_SET_VALUE, &hKey) == ERROR_SUCCESS) {
+		LONG result = RegDeleteValueW(hKey, valueName);
+		RegCloseKey(hKey);
+		return result == ERROR_SUCCESS;
+	}
+	return false;
+}
+
+std::vector<std::wstring> RegistryStore::GetApps() {
+	TRACE_SCOPE("store", "RegistryStore::GetApps");
+	HKEY hKey;
+	std::vector<std::wstring> appList;
+
+	if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, IFEO_PATH, 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
+		WCHAR name[256];
+		DWORD nameSize, index = 0;
+
+		while (true) {
+			nameSize = _countof(name);
+			if (RegEnumKeyExW(hKey, index++, name, &nameSize, NULL, NULL, NULL, NULL) != ERROR_SUCCESS)
+				break;
+
+			if (IsIgnoredKey(name))
+				continue; // skip this key
+
+			appList.push_back(name);
+		}
+		RegCloseKey(hKey);
+	}
+	return appList;
+}
+
+bool RegistryStore::GetPriority(const std::wstring& appName, DWORD& priority) {
+	TRACE_SCOPE("store", "RegistryStore::GetPriority");
+	std::wstring subkey = GetRegPath(appName);
+	HKEY hKey;
+	if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, subkey.c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
+		DWORD dataSize = sizeof(DWORD);
+		LONG result = RegQueryValueExW(hKey, RegPriority, NULL, NULL, (LPBYTE)&priority, &dataSize);
+		RegCloseKey(hKey);
+		return result == ERROR_SUCCESS;
+	}
+	return false;
+}
+
+bool RegistryStore::SetPriority(const std::wstring& appName, DWORD priority) {
+	TRACE_SCOPE("store", "RegistryStore::SetPriority");
+	std::wstring perfKey = GetRegPath(appName);
+	HKEY hKey;
+	if (RegCreateKeyExW(HKEY_LOCAL_MACHINE, perfKey.c_str(), 0, NULL, 0, KEY_WRITE, NULL, &hKey, NULL) == ERROR_SUCCESS) {
+		LONG result = RegSetValueExW(hKey, RegPriority, 0, REG_DWORD, (const BYTE*)&priority, sizeof(DWORD));
+		SetPriorityManage(hKey);
+		RegCloseKey(hKey);
+		return result == ERROR_SUCCESS;
+	}
+	return false;
+}
+
+void RegistryStore::DefaultPriority(const std::wstring& appName) {
+	TRACE_SCOPE("store", "RegistryStore::DefaultPriority");
+	std::wstring perfKey = GetRegPath(appName);
+	HKEY hKey;
+	if (RegCreateKeyExW(HKEY_LOCAL_MACHINE, perfKey.c_str(), 0, NULL, 0, KEY_WRITE, NULL, &hKey, NULL) == ERROR_SUCCESS) {
+		SetPriorityManage(hKey);
+		RegCloseKey(hKey);
+	}
+}
+
+bool RegistryStore::ClearPriority(const std::wstring& appName) {
+	TRACE_SCOPE("store", "RegistryStore::ClearPriority");
+	return DeletePerfValue(appName, RegPriority); // Only remove priority value
+}
+
+bool RegistryStore::Unmanage(const std::wstring& appName) {
+	TRACE_SCOPE("store", "RegistryStore::Unmanage");
+	return DeletePerfValue(appName, RegManaged);
+}
+
+// Through Commit, so it removes exactly what a batched removal does (see ApplyChange)
+bool RegistryStore::RemoveApp(const std::wstring& appName) {
+	TRACE_SCOPE("store", "RegistryStore::RemoveApp");
+	WriteBatch batch;
+	batch.RemoveApp(appName);
+	return Commit(batch);
+}
+
+bool RegistryStore::IsSetPriorityApp(const std::wstring& appName) {
+	TRACE_SCOPE("store", "RegistryStore::IsSetPriorityApp");
+	std::wstring subkey = GetRegPath(appName);
+	HKEY hKey;
+	if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, subkey.c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
+		DWORD value = 0;
+		DWORD valueSize = sizeof(DWORD);
+		LONG result = RegQueryValueExW(hKey, RegManaged, NULL, NULL, (LPBYTE)&value, &valueSize);
+		RegCloseKey(hKey);
+		return (result == ERROR_SUCCESS && value == 1);
+	}
+	return false;
+}
+
+static uint64_t FileTimeStamp(const FILETIME& time) {
+	return (uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+}
+
+static void ReadPerfValues(HKEY hPerf, AppRecord& record) {
+	record.perfOptions = true;
+
+	DWORD value = 0, valueSize = sizeof(DWORD);
+	if (RegQueryValueExW(hPerf, RegPriority, NULL, NULL, (LPBYTE)&value, &valueSize) == ERROR_SUCCESS) {
+		record.hasPriority = true;
+		record.priority = value;
+	}
+
+	value = 0;
+	valueSize = sizeof(DWORD);
+	if (RegQueryValueExW(hPerf, RegManaged, NULL, NULL, (LPBYTE)&value, &valueSize) == ERROR_SUCCESS) {
+		record.managed = value == 1;
+	}
+
+	value = 0;
+	valueSize = sizeof(DWORD);
+	if (RegQueryValueExW(hPerf, RegIoPriority, NULL, NULL, (LPBYTE)&value, &valueSize) == ERROR_SUCCESS) {
+		record.hasIoPriority = true;
+		record.ioPriority = value;
+	}
+
+	value = 0;
+	valueSize = sizeof(DWORD);
+	if (RegQueryValueExW(hPerf, RegPagePriority, NULL, NULL, (LPBYTE)&value, &valueSize) == ERROR_SUCCESS) {
+		record.hasPagePriority = true;
+		record.pagePriority = value;
+	}
+
+	value = 0;
+	valueSize = sizeof(DWORD);
+	if (RegQueryValueExW(hPerf, RegNumaNode, NULL, NULL, (LPBYTE)&value, &valueSize) == ERROR_SUCCESS) {
+		record.numaNode = (int)value;
+	}
+
+	valueSize = sizeof(DWORD);
+	if (RegQueryValueExW(hPerf, RegCpuWeight, NULL, NULL, (LPBYTE)&record.cpuWeight, &valueSize) != ERROR_SUCCESS)
+		record.cpuWeight = 0;
+	valueSize = sizeof(DWORD);
+	if (RegQueryValueExW(hPerf, RegCpuQuota, NULL, NULL, (LPBYTE)&record.cpuQuota, &valueSize) != ERROR_SUCCESS)
+		record.cpuQuota = 0;
+	valueSize = sizeof(DWORD);
+	if (RegQueryValueExW(hPerf, RegMinPriority, NULL, NULL, (LPBYTE)&record.minPriority, &valueSize) != ERROR_SUCCESS)
+		record.minPriority = 0;
+	valueSize = sizeof(DWORD);
+	if (RegQueryValueExW(hPerf, RegMaxPriority, NULL, NULL, (LPBYTE)&record.maxPriority, &valueSize) != ERROR_SUCCESS)
+		record.maxPriority = 0;
+
+	WCHAR cpus[256];
+	DWORD cpusSize = sizeof(cpus) - sizeof(WCHAR), type = 0;
+	if (RegQueryValueExW(hPerf, RegCpuSet, NULL, &type, (LPBYTE)cpus, &cpusSize) == ERROR_SUCCESS && type == REG_SZ) {
+		cpus[cpusSize / sizeof(WCHAR)] = L'\0'; // REG_SZ is not guaranteed to be terminated
+		NormalizeCpuList(cpus, record.cpuSet);
+	}
+
+	// no fixed cap on thread rules: size it first, then read; retry if it grew in between
+	std::wstring threads;
+	DWORD threadsSize = 0;
+	LONG result = RegQueryValueExW(hPerf, RegThreadRules, NULL, &type, NULL, &threadsSize);
+	while (result == ERROR_SUCCESS && type == REG_SZ) {
+		threads.resize(threadsSize / sizeof(WCHAR) + 1);
+		threadsSize = DWORD((threads.size() - 1) * sizeof(WCHAR));
+		result = RegQueryValueExW(hPerf, RegThreadRules, NULL, &type, (LPBYTE)&threads[0], &threadsSize);
+		if (result == ERROR_MORE_DATA) result = ERROR_SUCCESS;
+		else if (result == ERROR_SUCCESS) break;
+	}
+	if (result == ERROR_SUCCESS && type == REG_SZ) {
+		threads.resize(threadsSize / sizeof(WCHAR)); // REG_SZ is not guaranteed to be terminated
+		while (!threads.empty() && threads.back() == L'\0') threads.pop_back();
+		NormalizeThreadRules(threads, record.threadRules);
+	}
+}
+
+bool RegistryStore::ForEachApp(const std::function<bool(const AppRecord&)>& visit) {
+	return ForEachChangedApp([](const std::wstring&) -> const AppRecord* { return nullptr; }, visit);
+}
+
+// A value write bumps only its own key's time, so PerfOptions has to be opened for its stamp
+// either way; what a match saves is the value reads, which are most of the cost.
+bool RegistryStore::ForEachChangedApp(const KnownApps& known, const std::function<bool(const AppRecord&)>& visit) {
+	TRACE_SCOPE("store", "RegistryStore::ForEachChangedApp");
+	HKEY hIfeo;
+	if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, IFEO_PATH, 0, KEY_READ, &hIfeo) != ERROR_SUCCESS)
+		return false;
+
+	WCHAR name[256], subkey[256 + 16];
+	DWORD nameSize, index = 0;
+	FILETIME keyTime, perfTime;
+	bool completed = true;
+	AppRecord record;
+
+	while (true) {
+		nameSize = _countof(name);
+		LONG enumResult;
+		{
+			TRACE_SCOPE("registry", "RegEnumKeyExW");
+			enumResult = RegEnumKeyExW(hIfeo, index++, name, &nameSize, NULL, NULL, NULL, &keyTime);
+		}
+		if (enumResult != ERROR_SUCCESS)
+			break;
+
+		if (IsIgnoredKey(name))
+			continue; // skip this key
+
+		uint64_t readStart = TracingEnabled() ? TraceNow() : 0;
+		record.name.assign(name, nameSize);
+		const AppRecord* cached = known(record.name);
+		uint64_t stamp = FileTimeStamp(keyTime);
+
+		// relative open: "<app>\PerfOptions" under the IFEO handle we already hold
+		swprintf_s(subkey, L"%s\\PerfOptions", name);
+		HKEY hPerf;
+		bool reused = false;
+		if (RegOpenKeyExW(hIfeo, subkey, 0, KEY_QUERY_VALUE, &hPerf) == ERROR_SUCCESS) {
+			if (RegQueryInfoKeyW(hPerf, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &perfTime) == ERROR_SUCCESS)
+				stamp = FileTimeStamp(perfTime) > stamp ? FileTimeStamp(perfTime) : stamp;
+			else
+				stamp = 0; // unknown: never matches
+			reused = cached && stamp != 0 && cached->perfOptions && cached->lastWrite == stamp;
+			if (!reused) {
+				record = AppRecord{};
+				record.name.assign(name, nameSize);
+				ReadPerfValues(hPerf, record);
+			}
+			RegCloseKey(hPerf);
+		}
+		else {
+			reused = cached && !cached->perfOptions && cached->lastWrite == stamp;
+			if (!reused) {
+				record = AppRecord{};
+				record.name.assign(name, nameSize);
+			}
+		}
+
+		if (reused) {
+			record = *cached;
+			record.name.assign(name, nameSize); // the key's own spelling
+		}
+		record.lastWrite = stamp;
+
+		if (readStart) RecordTrace("registry", reused ? "reuse PerfOptions" : "read PerfOptions", readStart, TraceNow() - readStart);
+		if (!visit(record)) {
+			completed = false;
+			break;
+		}
+	}
+
+	RegCloseKey(hIfeo);
+	return completed;
+}
+
+static bool SetOrDeleteDword(HKEY hKey, const wchar_t* valueName, ValueOp op, DWORD value) {
+	if (op == ValueOp::Set)
+		return RegSetValueExW(hKey, valueName, 0, REG_DWORD, (const BYTE*)&value, sizeof(DWORD)) == ERROR_SUCCESS;
+	if (op == ValueOp::Clear) {
+		LONG result = RegDeleteValueW(hKey, valueName);
+		return result == ERROR_SUCCESS || result == ERROR_FILE_NOT_FOUND;
+	}
+	return true;
+}
+
+// One change against the open IFEO root, transacted when hTx is set
+static bool ApplyChange(HKEY hIfeo, HANDLE hTx, const PendingChange& change) {
+	const std::wstring perfKey = change.name + L"\\PerfOptions";
+
+	if (change.remove) {
+		// Only what SetPriority owns: PerfOptions, then the app key if that leaves it empty.
+		// Debugger, GlobalFlag, MitigationOptions and other tools' subkeys stay where they are.
+		LONG result = hTx
+			? RegDeleteKeyTransactedW(hIfeo, perfKey.c_str(), 0, 0, hTx, NULL)
+			: RegDeleteKeyW(hIfeo, perfKey.c_str());
+		if (result != ERROR_SUCCESS && result != ERROR_FILE_NOT_FOUND)
+			return false;
+
+		HKEY hApp;
+		result = hTx
+			? RegOpenKeyTransactedW(hIfeo, change.name.c_str(), 0, KEY_QUERY_VALUE, &hApp, hTx, NULL)
+			: RegOpenKeyExW(hIfeo, change.name.c_str(), 0, KEY_QUERY_VALUE, &hApp);
+		if (result == ERROR_SUCCESS) {
+			DWORD subkeys = 0, values = 0;
+			result = RegQueryInfoKeyW(hApp, NULL, NULL, NULL, &subkeys, NULL, NULL, &values, NULL, NULL, NULL, NULL);
+			RegCloseKey(hApp);
+			if (result != ERROR_SUCCESS) return false;
+			if (subkeys == 0 && values == 0) {
+				result = hTx
+					? RegDeleteKeyTransactedW(hIfeo, change.name.c_str(), 0, 0, hTx, NULL)
+					: RegDeleteKeyW(hIfeo, change.name.c_str());
+			}
+		}
+		if (result != ERROR_SUCCESS && result != ERROR_FILE_NOT_FOUND)
+			return false;
+	}
+
+	if (!change.create && change.priority == ValueOp::Keep && change.managed == ValueOp::Keep &&
+		change.ioPriority == ValueOp::Keep && change.pagePriority == ValueOp::Keep &&
+		change.cpuSet == ValueOp::Keep && change.numaNode == ValueOp::Keep &&
+		change.cpuWeight == ValueOp::Keep && change.cpuQuota == ValueOp::Keep &&
+		change.minPriority == ValueOp::Keep && change.maxPriority == ValueOp::Keep &&
+		change.threadRules == ValueOp::Keep)
+		return true;
+
+	HKEY hPerf;
+	LONG result;
+	if (change.create) {
+		result = hTx
+			? RegCreateKeyTransactedW(hIfeo, perfKey.c_str(), 0, NULL, 0, KEY_WRITE, NULL, &hPerf, NULL, hTx, NULL)
+			: RegCreateKeyExW(hIfeo, perfKey.c_str(), 0, NULL, 0, KEY_WRITE, NULL, &hPerf, NULL);
+	}
+	else {
+		result = hTx
+			? RegOpenKeyTransactedW(hIfeo, perfKey.c_str(), 0, KEY_SET_VALUE, &hPerf, hTx, NULL)
+			: RegOpenKeyExW(hIfeo, perfKey.c_str(), 0, KEY_SET_VALUE, &hPerf);
+		if (result == ERROR_FILE_NOT_FOUND) return true; // nothing to clear
+	}
+	if (result != ERROR_SUCCESS) return false;
+
+	bool ok = SetOrDeleteDword(hPerf, RegPriority, change.priority, change.priorityValue);
+	ok = ok && SetOrDeleteDword(hPerf, RegManaged, change.managed, 1);
+	ok = ok && SetOrDeleteDword(hPerf, RegIoPriority, change.ioPriority, change.ioPriorityValue);
+	ok = ok && SetOrDeleteDword(hPerf, RegPagePriority, change.pagePriority, change.pagePriorityValue);
+
+	if (ok && change.cpuSet == ValueOp::Set) {
+		const std::wstring& cpus = change.cpuSetValue;
+		ok = RegSetValueExW(hPerf, RegCpuSet, 0, REG_SZ, (const BYTE*)cpus.c_str(), DWORD((cpus.size() + 1) * sizeof(WCHAR))) == ERROR_SUCCESS;
+	}
+	else if (ok && change.cpuSet == ValueOp::Clear) {
+		result = RegDeleteValueW(hPerf, RegCpuSet);
+		ok = result == ERROR_SUCCESS || result == ERROR_FILE_NOT_FOUND;
+	}
+
+	ok = ok && SetOrDeleteDword(hPerf, RegNumaNode, change.numaNode, change.numaNodeValue);
+	ok = ok && SetOrDeleteDword(hPerf, RegCpuWeight, change.cpuWeight, change.cpuWeightValue);
+	ok = ok && SetOrDeleteDword(hPerf, RegCpuQuota, change.cpuQuota, change.cpuQuotaValue);
+	ok = ok && SetOrDeleteDword(hPerf, RegMinPriority, change.minPriority, change.minPriorityValue);
+	ok = ok && SetOrDeleteDword(hPerf, RegMaxPriority, change.maxPriority, change.maxPriorityValue);
+
+	if (ok && change.threadRules == ValueOp::Set) {
+		const std::wstring& threads = change.threadRulesValue;
+		ok = RegSetValueExW(hPerf, RegThreadRules, 0, REG_SZ, (const BYTE*)threads.c_str(), DWORD((threads.size() + 1) * sizeof(WCHAR))) == ERROR_SUCCESS;
+	}
+	else if (ok && change.threadRules == ValueOp::Clear) {
+		result = RegDeleteValueW(hPerf, RegThreadRules);
+		ok = result == ERROR_SUCCESS || result == ERROR_FILE_NOT_FOUND;
+	}
+
+	RegCloseKey(hPerf);
+	return ok;
+}
+
+bool RegistryStore::Commit(const WriteBatch& batch) {
+	if (batch.Empty()) return true;
+	TRACE_SCOPE("store", "RegistryStore::Commit");
+
+	// Without KTM (stripped-down systems, some containers) fall back to plain writes:
+	// still coalesced and under one IFEO handle, just not atomic
+	HANDLE hTx = CreateTransaction(NULL, NULL, 0, 0, 0, 0, const_cast<LPWSTR>(L"SetPriority"));
+	if (hTx == INVALID_HANDLE_VALUE) hTx = NULL;
+
+	HKEY hIfeo;
+	LONG result = hTx
+		? RegOpenKeyTransactedW(HKEY_LOCAL_MACHINE, IFEO_PATH, 0, KEY_ALL_ACCESS, &hIfeo, hTx, NULL)
+		: RegOpenKeyExW(HKEY_LOCAL_MACHINE, IFEO_PATH, 0, KEY_ALL_ACCESS, &hIfeo);
+	if (result != ERROR_SUCCESS) {
+		if (hTx) CloseHandle(hTx);
+		return false;
+	}
+
+	bool ok = true;
+	for (const auto& change : batch.Changes()) {
+		if (!ApplyChange(hIfeo, hTx, change)) {
+			ok = false;
+			break;
+		}
+	}
+	RegCloseKey(hIfeo);
+
+	if (hTx) {
+		if (ok)
+			ok = CommitTransaction(hTx) != FALSE;
+		else
+			RollbackTransaction(hTx);
+		CloseHandle(hTx);
+	}
+	return ok;
+}
+#endif
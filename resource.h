@@ -32,8 +32,19 @@
 #define IDM_SHORTCUT					127
 #define IDD_SHORTCUT					128
 #define IDC_UNMANAGED					129
+#define IDM_IMPORT						130
+#define IDM_EXPORT						131
+#define IDC_CPUSET						132
+#define IDC_NUMA_NODE					133
+#define IDC_IO_COMBO					134
+#define IDC_PAGE_COMBO					135
+#define IDM_SAVE_TRACE					136
+#define IDM_OPEN_EXPORT					137
+#define IDM_SWITCH_PROFILE				138
+#define IDM_SAVE_PROFILE				139
 #define LISTVIEW					    1001
 #define STATUSBAR						1002
+#define FILTERBOX						1003
 #define IDC_STATIC                      -1
 
 // Next default values for new objects
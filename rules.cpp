@@ -0,0 +1,99 @@
+#include "rules.h"
+
+#include <utility>
+#include <vector>
+
+bool ApplyRule(WriteBatch& batch, const AppRecord& rule) {
+	if (!rule.perfOptions) return false; // a bare name carries no setting
+
+	if (rule.hasPriority) {
+		batch.SetPriority(rule.name, rule.priority);
+	}
+	else {
+		batch.DefaultPriority(rule.name);
+		batch.ClearPriority(rule.name);
+	}
+
+	if (!rule.managed)
+		batch.Unmanage(rule.name);
+
+	// a rule line is the app's whole setting: what it leaves out is cleared
+	batch.SetIoPriority(rule.name, rule.hasIoPriority ? (int)rule.ioPriority : -1);
+	batch.SetPagePriority(rule.name, rule.hasPagePriority ? (int)rule.pagePriority : -1);
+	batch.SetCpuSet(rule.name, rule.cpuSet);
+	batch.SetNumaNode(rule.name, rule.numaNode);
+	batch.SetCpuWeight(rule.name, rule.cpuWeight);
+	batch.SetCpuQuota(rule.name, rule.cpuQuota);
+	batch.SetPriorityBounds(rule.name, rule.minPriority, rule.maxPriority);
+	batch.SetThreadRules(rule.name, rule.threadRules);
+	return true;
+}
+
+bool ApplyRule(PriorityStore& store, const AppRecord& rule) {
+	WriteBatch batch;
+	return ApplyRule(batch, rule) && store.Commit(batch);
+}
+
+void ReadRuleLines(std::istream& in,
+	const std::function<void(size_t, const std::wstring&, const AppRecord*)>& visit) {
+	std::string line;
+	line.reserve(512);
+	for (size_t lineNo = 1; std::getline(in, line); ++lineNo) {
+		if (lineNo == 1 && line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+			line.erase(0, 3); // UTF-8 BOM from Notepad
+		if (line.empty() || line[0] == '#' || line[0] == '\r') continue;
+
+		AppRecord rule;
+		std::wstring text = Utf8ToWide(line);
+		bool parsed = ParseEntryLine(text, rule) && rule.perfOptions; // a bare name carries no setting
+		visit(lineNo, text, parsed ? &rule : nullptr);
+	}
+}
+
+ImportResult ImportRules(PriorityStore& store, std::istream& in,
+	const std::function<void(size_t, const std::wstring&)>& onError) {
+	ImportResult result;
+	WriteBatch batch;
+	std::vector<std::pair<size_t, std::wstring>> queued; // what the batch holds, for error reports
+	queued.reserve(IMPORT_CHUNK);
+	auto flush = [&]() {
+		if (queued.empty()) return;
+		if (store.Commit(batch)) {
+			result.applied += queued.size();
+		}
+		else {
+			result.failed += queued.size();
+			if (onError) {
+				for (const auto& rule : queued)
+					onError(rule.first, rule.second);
+			}
+		}
+		batch.Clear();
+		queued.clear();
+	};
+
+	ReadRuleLines(in, [&](size_t lineNo, const std::wstring& text, const AppRecord* rule) {
+		if (!rule || !ApplyRule(batch, *rule)) {
+			if (onError) onError(lineNo, text);
+			++result.failed;
+			return;
+		}
+		queued.emplace_back(lineNo, text);
+		if (queued.size() == IMPORT_CHUNK) flush();
+	});
+	flush();
+	return result;
+}
+
+size_t ExportRules(PriorityStore& store, std::ostream& out, bool includeUnmanaged) {
+	size_t written = 0;
+	out << "# SetPriority rules: " << ENTRY_LINE_SYNTAX << '\n';
+	store.ForEachApp([&](const AppRecord& app) {
+		if (!app.perfOptions || (!app.managed && !includeUnmanaged))
+			return true;
+		out << WideToUtf8(FormatEntryLine(app)) << '\n';
+		++written;
+		return bool(out);
+	});
+	return written;
+}
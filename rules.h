@@ -0,0 +1,38 @@
+#pragma once
+
+#include "store.h"
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+
+// Rule files: one FormatEntryLine per app, UTF-8, '#' comments. Both directions stream
+// line by line, so memory stays flat however many rules a file holds.
+
+struct ImportResult {
+	size_t applied = 0;
+	size_t failed = 0;
+};
+
+// Queue one parsed rule line the way AddDlg/EditDlg would; false for a rule with no setting
+bool ApplyRule(WriteBatch& batch, const AppRecord& rule);
+bool ApplyRule(PriorityStore& store, const AppRecord& rule); // one-rule batch, committed now
+
+// Every rule line of a rule file in order, with its 1-based line number and text; rule is
+// nullptr when the line does not parse or names an app without a setting. Blank lines and
+// comments are skipped.
+void ReadRuleLines(std::istream& in,
+	const std::function<void(size_t, const std::wstring&, const AppRecord*)>& visit);
+
+// Rules are committed in chunks of this many, each chunk all-or-nothing as far as the store's
+// Commit is (best-effort for RegistryStore without KTM); the import as a whole is not
+constexpr size_t IMPORT_CHUNK = 1024;
+
+// onError gets the 1-based line number and text of every rule that could not be applied.
+// When a chunk fails to commit, every rule in it is reported.
+ImportResult ImportRules(PriorityStore& store, std::istream& in,
+	const std::function<void(size_t, const std::wstring&)>& onError = nullptr);
+
+// Writes managed apps (and, with includeUnmanaged, every key that has PerfOptions);
+// returns the number of rules written
+size_t ExportRules(PriorityStore& store, std::ostream& out, bool includeUnmanaged);
@@ -0,0 +1,168 @@
+#include "snapcache.h"
+#include "mappedfile.h"
+#include "trace.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Native byte order and layout: the file is a cache for this machine, not an exchange format.
+// Bump the version whenever a struct below changes.
+constexpr uint16_t SNAPSHOT_VERSION = 3;
+static const char SnapshotMagic[6] = { 'S', 'P', 'S', 'N', 'A', 'P' };
+
+struct SnapshotHeader {
+	char magic[6];
+	uint16_t version;
+	uint32_t count;        // records right after the header
+	uint32_t stringsSize;  // pool right after the records
+};
+
+enum SnapshotFlags : uint32_t {
+	SnapPerfOptions = 1,
+	SnapHasPriority = 2,
+	SnapManaged = 4,
+	SnapHasIoPriority = 8,
+	SnapHasPagePriority = 16,
+	SnapSystem = 32,
+};
+
+struct SnapshotEntry {
+	uint64_t lastWrite;
+	uint32_t nameOffset, nameSize;     // into the string pool, UTF-8
+	uint32_t cpuSetOffset, cpuSetSize;
+	uint32_t threadRulesOffset, threadRulesSize;
+	uint32_t priority, ioPriority, pagePriority;
+	uint32_t cpuWeight, cpuQuota;
+	uint32_t minPriority, maxPriority;
+	int32_t numaNode;
+	uint32_t flags;                    // SnapshotFlags
+};
+
+static_assert(sizeof(SnapshotHeader) == 16, "snapshot header layout");
+static_assert(sizeof(SnapshotEntry) == 72, "snapshot entry layout");
+
+bool SnapshotCache::Load(std::vector<AppRecord>& apps) const {
+	TRACE_SCOPE("snapshot", "SnapshotCache::Load");
+	MappedFile file(path);
+	if (file.size < sizeof(SnapshotHeader)) return false;
+
+	SnapshotHeader header;
+	memcpy(&header, file.data, sizeof(header));
+	if (memcmp(header.magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0 || header.version != SNAPSHOT_VERSION)
+		return false;
+	uint64_t expected = sizeof(SnapshotHeader) + (uint64_t)header.count * sizeof(SnapshotEntry) + header.stringsSize;
+	if (expected != file.size) return false; // truncated or trailing garbage
+
+	const char* strings = file.data + sizeof(SnapshotHeader) + (size_t)header.count * sizeof(SnapshotEntry);
+	auto text = [&](uint32_t offset, uint32_t size, std::wstring& out) {
+		if ((uint64_t)offset + size > header.stringsSize) return false;
+		out = Utf8ToWide(std::string(strings + offset, size));
+		return true;
+	};
+
+	std::vector<AppRecord> loaded(header.count);
+	for (uint32_t i = 0; i < header.count; ++i) {
+		SnapshotEntry entry;
+		memcpy(&entry, file.data + sizeof(SnapshotHeader) + (size_t)i * sizeof(SnapshotEntry), sizeof(entry));
+
+		AppRecord& app = loaded[i];
+		if (!text(entry.nameOffset, entry.nameSize, app.name) || app.name.empty() ||
+			!text(entry.cpuSetOffset, entry.cpuSetSize, app.cpuSet) ||
+			!text(entry.threadRulesOffset, entry.threadRulesSize, app.threadRules))
+			return false;
+		app.lastWrite = entry.lastWrite;
+		app.perfOptions = (entry.flags & SnapPerfOptions) != 0;
+		app.hasPriority = (entry.flags & SnapHasPriority) != 0;
+		app.managed = (entry.flags & SnapManaged) != 0;
+		app.hasIoPriority = (entry.flags & SnapHasIoPriority) != 0;
+		app.hasPagePriority = (entry.flags & SnapHasPagePriority) != 0;
+		app.system = (entry.flags & SnapSystem) != 0;
+		app.priority = entry.priority;
+		app.ioPriority = entry.ioPriority;
+		app.pagePriority = entry.pagePriority;
+		app.cpuWeight = entry.cpuWeight;
+		app.cpuQuota = entry.cpuQuota;
+		app.minPriority = entry.minPriority;
+		app.maxPriority = entry.maxPriority;
+		app.numaNode = entry.numaNode;
+	}
+
+	apps = std::move(loaded);
+	return true;
+}
+
+bool SnapshotCache::Save(const std::vector<AppRecord>& apps) const {
+	TRACE_SCOPE("snapshot", "SnapshotCache::Save");
+	std::string pool;
+	std::vector<SnapshotEntry> entries;
+	entries.reserve(apps.size());
+	auto append = [&](const std::wstring& text, uint32_t& offset, uint32_t& size) {
+		std::string utf8 = WideToUtf8(text);
+		offset = (uint32_t)pool.size();
+		size = (uint32_t)utf8.size();
+		pool += utf8;
+	};
+
+	for (const auto& app : apps) {
+		SnapshotEntry entry{};
+		entry.lastWrite = app.lastWrite;
+		append(app.name, entry.nameOffset, entry.nameSize);
+		append(app.cpuSet, entry.cpuSetOffset, entry.cpuSetSize);
+		append(app.threadRules, entry.threadRulesOffset, entry.threadRulesSize);
+		entry.priority = app.priority;
+		entry.ioPriority = app.ioPriority;
+		entry.pagePriority = app.pagePriority;
+		entry.cpuWeight = app.cpuWeight;
+		entry.cpuQuota = app.cpuQuota;
+		entry.minPriority = app.minPriority;
+		entry.maxPriority = app.maxPriority;
+		entry.numaNode = app.numaNode;
+		entry.flags = (app.perfOptions ? SnapPerfOptions : 0u) | (app.hasPriority ? SnapHasPriority : 0u) |
+			(app.managed ? SnapManaged : 0u) | (app.hasIoPriority ? SnapHasIoPriority : 0u) |
+			(app.hasPagePriority ? SnapHasPagePriority : 0u) | (app.system ? SnapSystem : 0u);
+		entries.push_back(entry);
+	}
+	if (pool.size() > UINT32_MAX) return false;
+
+	SnapshotHeader header{};
+	memcpy(header.magic, SnapshotMagic, sizeof(SnapshotMagic));
+	header.version = SNAPSHOT_VERSION;
+	header.count = (uint32_t)entries.size();
+	header.stringsSize = (uint32_t)pool.size();
+
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+	std::filesystem::path temp = path;
+	temp += ".tmp";
+#ifdef _WIN32
+	FILE* file = _wfopen(temp.c_str(), L"wb");
+#else
+	FILE* file = fopen(temp.c_str(), "wb");
+#endif
+	if (!file) return false;
+	// a cache: no fsync, a torn file fails the size check and is rebuilt by the next scan
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		(entries.empty() || fwrite(entries.data(), sizeof(SnapshotEntry), entries.size(), file) == entries.size()) &&
+		fwrite(pool.data(), 1, pool.size(), file) == pool.size();
+	ok = fclose(file) == 0 && ok;
+	if (ok) std::filesystem::rename(temp, path, ec);
+	if (!ok || ec) {
+		std::filesystem::remove(temp, ec);
+		return false;
+	}
+	return true;
+}
+
+std::filesystem::path DefaultSnapshotPath() {
+#ifdef _WIN32
+	if (const wchar_t* local = _wgetenv(L"LOCALAPPDATA"))
+		return std::filesystem::path(local) / L"SetPriority" / L"snapshot.bin";
+	return std::filesystem::temp_directory_path() / L"SetPriority" / L"snapshot.bin";
+#else
+	if (const char* cache = getenv("XDG_CACHE_HOME"); cache && *cache)
+		return std::filesystem::path(cache) / "setpriority" / "snapshot.bin";
+	if (const char* home = getenv("HOME"); home && *home)
+		return std::filesystem::path(home) / ".cache" / "setpriority" / "snapshot.bin";
+	return std::filesystem::temp_directory_path() / "setpriority" / "snapshot.bin";
+#endif
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "store.h"
+#include <filesystem>
+#include <vector>
+
+// The last complete scan on disk, so the window can show the list before the store has been
+// read again. The file is mapped and decoded in place: a header, fixed-size records and one
+// pool of UTF-8 strings, every offset checked against the mapping before it is used. A
+// missing, short or foreign file is simply no cache.
+// Each record keeps its lastWrite stamp, which lets the follow-up scan skip keys that did
+// not change (PriorityStore::ForEachChangedApp).
+class SnapshotCache {
+public:
+	explicit SnapshotCache(std::filesystem::path path) : path(std::move(path)) {}
+
+	bool Load(std::vector<AppRecord>& apps) const;       // false: no usable cache, apps untouched
+	bool Save(const std::vector<AppRecord>& apps) const; // temp file and rename
+	const std::filesystem::path& Path() const { return path; }
+
+private:
+	std::filesystem::path path;
+};
+
+// %LOCALAPPDATA%\SetPriority\snapshot.bin, or $XDG_CACHE_HOME/setpriority/snapshot.bin
+std::filesystem::path DefaultSnapshotPath();
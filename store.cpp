@@ -0,0 +1,930 @@
+#include "store.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cwctype>
+#include <fstream>
+#include <iterator>
+#include <optional>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+const DWORD PriorityValues[7] = {
+	0,             // Not Set
+	0x00000001,     // Idle
+	0x00000005,     // Below Normal
+	0x00000002,     // Normal
+	0x00000006,     // Above Normal
+	0x00000003,     // High
+	0x00000004      // Realtime
+};
+
+const wchar_t* ConvertHexToName(DWORD priority)
+{
+	switch (priority)
+	{
+	case 1: return L"Idle";
+	case 5: return L"Below Normal";
+	case 2: return L"Normal";
+	case 6: return L"Above Normal";
+	case 3: return L"High";
+	case 4: return L"Realtime";
+	default: return L"(Unknown)";
+	}
+}
+
+const wchar_t* const IoPriorityNames[4] = { L"Very Low", L"Low", L"Normal", L"High" };
+const wchar_t* const PagePriorityNames[6] = { L"Lowest", L"Very Low", L"Low", L"Medium", L"Below Normal", L"Normal" };
+
+template <size_t N>
+static bool ParseLevel(const std::wstring& text, const wchar_t* const (&names)[N], DWORD& level) {
+	for (size_t i = 0; i < N; ++i) {
+		if (_wcsicmp(text.c_str(), names[i]) == 0) {
+			level = (DWORD)i;
+			return true;
+		}
+	}
+
+	if (text.empty()) return false;
+	wchar_t* end = nullptr;
+	unsigned long value = wcstoul(text.c_str(), &end, 0);
+	if (*end != L'\0' || value >= N) return false;
+	level = (DWORD)value;
+	return true;
+}
+
+template <size_t N>
+static std::wstring LevelText(DWORD level, const wchar_t* const (&names)[N]) {
+	return level < N ? names[level] : std::to_wstring(level);
+}
+
+bool ParseIoPriority(const std::wstring& text, DWORD& io) {
+	return ParseLevel(text, IoPriorityNames, io);
+}
+
+bool ParsePagePriority(const std::wstring& text, DWORD& page) {
+	return ParseLevel(text, PagePriorityNames, page);
+}
+
+int PriorityRank(DWORD priority) {
+	for (size_t i = 1; i < std::size(PriorityValues); ++i) {
+		if (PriorityValues[i] == priority) return (int)i;
+	}
+	return 0;
+}
+
+bool ConvertNameToHex(const std::wstring& name, DWORD& priority) {
+	for (size_t i = 1; i < std::size(PriorityValues); ++i) {
+		if (_wcsicmp(name.c_str(), ConvertHexToName(PriorityValues[i])) == 0) {
+			priority = PriorityValues[i];
+			return true;
+		}
+	}
+
+	// raw CpuPriorityClass values are accepted too ("3", "0x3")
+	if (name.empty()) return false;
+	wchar_t* end = nullptr;
+	unsigned long value = wcstoul(name.c_str(), &end, 0);
+	if (*end != L'\0') return false;
+	priority = (DWORD)value;
+	return true;
+}
+
+bool IsIgnoredKey(const std::wstring& keyName) {
+	return _wcsicmp(keyName.c_str(), L"{ApplicationVerifierGlobalSettings}") == 0;
+}
+
+bool SameSettings(const AppRecord& a, const AppRecord& b) {
+	return a.perfOptions == b.perfOptions && a.hasPriority == b.hasPriority &&
+		(!a.hasPriority || a.priority == b.priority) && a.managed == b.managed &&
+		a.hasIoPriority == b.hasIoPriority && (!a.hasIoPriority || a.ioPriority == b.ioPriority) &&
+		a.hasPagePriority == b.hasPagePriority && (!a.hasPagePriority || a.pagePriority == b.pagePriority) &&
+		a.cpuSet == b.cpuSet && a.numaNode == b.numaNode &&
+		a.cpuWeight == b.cpuWeight && a.cpuQuota == b.cpuQuota &&
+		a.minPriority == b.minPriority && a.maxPriority == b.maxPriority && a.threadRules == b.threadRules;
+}
+
+std::string WideToUtf8(const std::wstring& text) {
+	std::string out;
+	out.reserve(text.size());
+	for (size_t i = 0; i < text.size(); ++i) {
+		unsigned long c = (unsigned long)text[i];
+		if (sizeof(wchar_t) == 2 && c >= 0xD800 && c <= 0xDBFF && i + 1 < text.size()) {
+			unsigned long low = (unsigned long)text[i + 1];
+			if (low >= 0xDC00 && low <= 0xDFFF) {
+				c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+				++i;
+			}
+		}
+
+		if (c < 0x80) {
+			out += (char)c;
+		}
+		else if (c < 0x800) {
+			out += (char)(0xC0 | (c >> 6));
+			out += (char)(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000) {
+			out += (char)(0xE0 | (c >> 12));
+			out += (char)(0x80 | ((c >> 6) & 0x3F));
+			out += (char)(0x80 | (c & 0x3F));
+		}
+		else {
+			out += (char)(0xF0 | (c >> 18));
+			out += (char)(0x80 | ((c >> 12) & 0x3F));
+			out += (char)(0x80 | ((c >> 6) & 0x3F));
+			out += (char)(0x80 | (c & 0x3F));
+		}
+	}
+	return out;
+}
+
+std::wstring Utf8ToWide(const std::string& text) {
+	std::wstring out;
+	out.reserve(text.size());
+	for (size_t i = 0; i < text.size();) {
+		unsigned char lead = (unsigned char)text[i];
+		unsigned long c;
+		size_t extra;
+		if (lead < 0x80) { c = lead; extra = 0; }
+		else if ((lead & 0xE0) == 0xC0) { c = lead & 0x1F; extra = 1; }
+		else if ((lead & 0xF0) == 0xE0) { c = lead & 0x0F; extra = 2; }
+		else if ((lead & 0xF8) == 0xF0) { c = lead & 0x07; extra = 3; }
+		else { out += L'\xFFFD'; ++i; continue; } // stray continuation byte
+
+		if (extra && i + extra >= text.size()) { out += L'\xFFFD'; break; } // truncated sequence
+		for (size_t k = 1; k <= extra; ++k) {
+			c = (c << 6) | ((unsigned char)text[i + k] & 0x3F);
+		}
+		i += extra + 1;
+
+		if (sizeof(wchar_t) == 2 && c >= 0x10000) {
+			c -= 0x10000;
+			out += (wchar_t)(0xD800 + (c >> 10));
+			out += (wchar_t)(0xDC00 + (c & 0x3FF));
+		}
+		else {
+			out += (wchar_t)c;
+		}
+	}
+	return out;
+}
+
+std::wstring FoldCase(const std::wstring& text) {
+	std::wstring out(text);
+	for (auto& c : out) c = (wchar_t)towlower(c);
+	return out;
+}
+
+static std::wstring Trim(const std::wstring& text) {
+	size_t first = text.find_first_not_of(L" \t\r\n");
+	if (first == std::wstring::npos) return L"";
+	size_t last = text.find_last_not_of(L" \t\r\n");
+	return text.substr(first, last - first + 1);
+}
+
+bool ParseCpuList(const std::wstring& text, std::vector<unsigned>& cpus) {
+	cpus.clear();
+	size_t start = 0;
+	while (start <= text.size()) {
+		size_t comma = text.find(L',', start);
+		std::wstring range = Trim(text.substr(start, comma == std::wstring::npos ? std::wstring::npos : comma - start));
+		start = comma == std::wstring::npos ? text.size() + 1 : comma + 1;
+		if (range.empty()) return false;
+
+		wchar_t* end = nullptr;
+		unsigned long first = wcstoul(range.c_str(), &end, 10), last = first;
+		if (end == range.c_str()) return false;
+		if (*end == L'-') {
+			const wchar_t* from = end + 1;
+			last = wcstoul(from, &end, 10);
+			if (end == from) return false;
+		}
+		if (*end != L'\0' || first > last || last >= MAX_CPUS) return false;
+
+		for (unsigned long cpu = first; cpu <= last; ++cpu)
+			cpus.push_back((unsigned)cpu);
+	}
+	std::sort(cpus.begin(), cpus.end());
+	cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+	return true;
+}
+
+std::wstring FormatCpuList(const std::vector<unsigned>& cpus) {
+	std::wstring text;
+	for (size_t i = 0; i < cpus.size();) {
+		size_t j = i;
+		while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+
+		if (!text.empty()) text += L',';
+		text += std::to_wstring(cpus[i]);
+		if (j > i) text += L'-' + std::to_wstring(cpus[j]);
+		i = j + 1;
+	}
+	return text;
+}
+
+bool ParseThreadRules(const std::wstring& text, std::vector<ThreadRule>& rules) {
+	rules.clear();
+	for (size_t start = 0; start <= text.size();) {
+		size_t end = text.find(L';', start);
+		if (end == std::wstring::npos) end = text.size();
+		std::wstring item = Trim(text.substr(start, end - start));
+		start = end + 1;
+		if (item.empty()) continue;
+
+		size_t colon = item.rfind(L':');
+		if (colon == std::wstring::npos) return false;
+		ThreadRule rule;
+		rule.name = Trim(item.substr(0, colon));
+		if (rule.name.empty() || rule.name.find(L',') != std::wstring::npos) return false;
+		for (wchar_t c : rule.name) {
+			if (c < 0x20) return false;
+		}
+		if (!ConvertNameToHex(Trim(item.substr(colon + 1)), rule.priority)) return false;
+		rules.push_back(std::move(rule));
+	}
+	return true;
+}
+
+std::wstring FormatThreadRules(const std::vector<ThreadRule>& rules) {
+	std::wstring text;
+	for (const auto& rule : rules) {
+		if (!text.empty()) text += L';';
+		text += rule.name + L":" + ConvertHexToName(rule.priority);
+	}
+	return text;
+}
+
+bool NormalizeThreadRules(const std::wstring& text, std::wstring& normalized) {
+	std::vector<ThreadRule> rules;
+	if (!ParseThreadRules(text, rules)) return false;
+	normalized = FormatThreadRules(rules);
+	return true;
+}
+
+bool NormalizeCpuList(const std::wstring& text, std::wstring& normalized) {
+	if (Trim(text).empty()) {
+		normalized.clear();
+		return true;
+	}
+	std::vector<unsigned> cpus;
+	if (!ParseCpuList(text, cpus)) return false;
+	normalized = FormatCpuList(cpus);
+	return true;
+}
+
+bool ParseEntryLine(const std::wstring& line, AppRecord& record) {
+	record = AppRecord{};
+
+	size_t eq = line.find(L'=');
+	record.name = Trim(line.substr(0, eq));
+	if (record.name.empty()) return false;
+	if (eq == std::wstring::npos) return true; // bare IFEO key, no PerfOptions
+
+	record.perfOptions = true;
+	record.managed = true;
+
+	std::wstring rest = line.substr(eq + 1);
+	std::wstring cpuList;
+	bool inCpuList = false; // "cpus=0-3,8": the list's own commas split it into tokens
+	size_t start = 0;
+	for (int field = 0; start <= rest.size(); ++field) {
+		size_t comma = rest.find(L',', start);
+		std::wstring token = Trim(rest.substr(start, comma == std::wstring::npos ? std::wstring::npos : comma - start));
+		start = comma == std::wstring::npos ? rest.size() + 1 : comma + 1;
+
+		if (inCpuList && !token.empty() && iswdigit(token[0])) {
+			cpuList += L',' + token;
+			continue;
+		}
+		inCpuList = false;
+
+		if (field == 0) {
+			if (token.empty() || _wcsicmp(token.c_str(), L"Default") == 0) continue;
+			if (!ConvertNameToHex(token, record.priority)) return false;
+			record.hasPriority = true;
+		}
+		else if (_wcsicmp(token.c_str(), L"unmanaged") == 0) {
+			record.managed = false;
+		}
+		else if (_wcsnicmp(token.c_str(), L"io=", 3) == 0) {
+			if (!ParseIoPriority(token.substr(3), record.ioPriority)) return false;
+			record.hasIoPriority = true;
+		}
+		else if (_wcsnicmp(token.c_str(), L"page=", 5) == 0) {
+			if (!ParsePagePriority(token.substr(5), record.pagePriority)) return false;
+			record.hasPagePriority = true;
+		}
+		else if (_wcsnicmp(token.c_str(), L"cpus=", 5) == 0) {
+			cpuList = token.substr(5);
+			inCpuList = true;
+		}
+		else if (_wcsnicmp(token.c_str(), L"weight=", 7) == 0) {
+			wchar_t* end = nullptr;
+			unsigned long weight = wcstoul(token.c_str() + 7, &end, 10);
+			if (end == token.c_str() + 7 || *end != L'\0' || weight < 1 || weight > 10000) return false;
+			record.cpuWeight = (DWORD)weight;
+		}
+		else if (_wcsnicmp(token.c_str(), L"quota=", 6) == 0) {
+			wchar_t* end = nullptr;
+			unsigned long quota = wcstoul(token.c_str() + 6, &end, 10);
+			if (*end == L'%') ++end;
+			if (end == token.c_str() + 6 || *end != L'\0' || quota < 1 || quota > 100 * MAX_CPUS) return false;
+			record.cpuQuota = (DWORD)quota;
+		}
+		else if (_wcsnicmp(token.c_str(), L"threads=", 8) == 0) {
+			if (!NormalizeThreadRules(token.substr(8), record.threadRules) || record.threadRules.empty()) return false;
+		}
+		else if (_wcsnicmp(token.c_str(), L"min=", 4) == 0) {
+			if (!ConvertNameToHex(token.substr(4), record.minPriority)) return false;
+		}
+		else if (_wcsnicmp(token.c_str(), L"max=", 4) == 0) {
+			if (!ConvertNameToHex(token.substr(4), record.maxPriority)) return false;
+		}
+		else if (_wcsnicmp(token.c_str(), L"node=", 5) == 0) {
+			wchar_t* end = nullptr;
+			unsigned long node = wcstoul(token.c_str() + 5, &end, 10);
+			if (end == token.c_str() + 5 || *end != L'\0' || node > 1023) return false;
+			record.numaNode = (int)node;
+		}
+		else if (!token.empty()) {
+			return false;
+		}
+	}
+	return NormalizeCpuList(cpuList, record.cpuSet) && (cpuList.empty() || !record.cpuSet.empty());
+}
+
+std::wstring FormatEntryLine(const AppRecord& record) {
+	if (!record.perfOptions) return record.name;
+
+	std::wstring line = record.name + L"=";
+	if (!record.hasPriority) {
+		line += L"Default";
+	}
+	else if (wcscmp(ConvertHexToName(record.priority), L"(Unknown)") == 0) {
+		line += std::to_wstring(record.priority);
+	}
+	else {
+		line += ConvertHexToName(record.priority);
+	}
+
+	if (!record.managed) line += L",unmanaged";
+	if (record.hasIoPriority) line += L",io=" + LevelText(record.ioPriority, IoPriorityNames);
+	if (record.hasPagePriority) line += L",page=" + LevelText(record.pagePriority, PagePriorityNames);
+	if (!record.cpuSet.empty()) line += L",cpus=" + record.cpuSet;
+	if (record.numaNode >= 0) line += L",node=" + std::to_wstring(record.numaNode);
+	if (record.cpuWeight) line += L",weight=" + std::to_wstring(record.cpuWeight);
+	if (record.cpuQuota) line += L",quota=" + std::to_wstring(record.cpuQuota) + L"%";
+	if (PriorityRank(record.minPriority)) line += std::wstring(L",min=") + ConvertHexToName(record.minPriority);
+	if (PriorityRank(record.maxPriority)) line += std::wstring(L",max=") + ConvertHexToName(record.maxPriority);
+	if (!record.threadRules.empty()) line += L",threads=" + record.threadRules;
+	return line;
+}
+
+std::vector<AppRecord> PriorityStore::LoadSnapshot() {
+	std::vector<AppRecord> snapshot;
+	ForEachApp([&](const AppRecord& record) {
+		snapshot.push_back(record);
+		return true;
+	});
+	return snapshot;
+}
+
+PendingChange& WriteBatch::At(const std::wstring& appName) {
+	auto inserted = index.emplace(FoldCase(appName), changes.size());
+	if (inserted.second) {
+		changes.emplace_back();
+		changes.back().name = appName;
+	}
+	return changes[inserted.first->second];
+}
+
+void WriteBatch::SetPriority(const std::wstring& appName, DWORD priority) {
+	PendingChange& change = At(appName);
+	change.create = true;
+	change.priority = ValueOp::Set;
+	change.priorityValue = priority;
+	change.managed = ValueOp::Set;
+}
+
+void WriteBatch::DefaultPriority(const std::wstring& appName) {
+	PendingChange& change = At(appName);
+	change.create = true;
+	change.managed = ValueOp::Set;
+}
+
+void WriteBatch::ClearPriority(const std::wstring& appName) {
+	At(appName).priority = ValueOp::Clear;
+}
+
+void WriteBatch::Unmanage(const std::wstring& appName) {
+	At(appName).managed = ValueOp::Clear;
+}
+
+void WriteBatch::RemoveApp(const std::wstring& appName) {
+	PendingChange& change = At(appName);
+	change = PendingChange{};
+	change.name = appName;
+	change.remove = true; // anything queued before is moot
+}
+
+void WriteBatch::SetIoPriority(const std::wstring& appName, int io) {
+	PendingChange& change = At(appName);
+	if (io < 0) {
+		change.ioPriority = ValueOp::Clear;
+		return;
+	}
+	change.create = true;
+	change.ioPriority = ValueOp::Set;
+	change.ioPriorityValue = (DWORD)io;
+}
+
+void WriteBatch::SetPagePriority(const std::wstring& appName, int page) {
+	PendingChange& change = At(appName);
+	if (page < 0) {
+		change.pagePriority = ValueOp::Clear;
+		return;
+	}
+	change.create = true;
+	change.pagePriority = ValueOp::Set;
+	change.pagePriorityValue = (DWORD)page;
+}
+
+void WriteBatch::SetCpuSet(const std::wstring& appName, const std::wstring& cpus) {
+	PendingChange& change = At(appName);
+	if (cpus.empty()) {
+		change.cpuSet = ValueOp::Clear;
+		change.cpuSetValue.clear();
+		return;
+	}
+	change.create = true;
+	change.cpuSet = ValueOp::Set;
+	change.cpuSetValue = cpus;
+}
+
+void WriteBatch::SetNumaNode(const std::wstring& appName, int node) {
+	PendingChange& change = At(appName);
+	if (node < 0) {
+		change.numaNode = ValueOp::Clear;
+		return;
+	}
+	change.create = true;
+	change.numaNode = ValueOp::Set;
+	change.numaNodeValue = (DWORD)node;
+}
+
+void WriteBatch::SetCpuWeight(const std::wstring& appName, DWORD weight) {
+	PendingChange& change = At(appName);
+	change.cpuWeight = weight ? ValueOp::Set : ValueOp::Clear;
+	change.cpuWeightValue = weight;
+	if (weight) change.create = true;
+}
+
+void WriteBatch::SetCpuQuota(const std::wstring& appName, DWORD percent) {
+	PendingChange& change = At(appName);
+	change.cpuQuota = percent ? ValueOp::Set : ValueOp::Clear;
+	change.cpuQuotaValue = percent;
+	if (percent) change.create = true;
+}
+
+void WriteBatch::SetPriorityBounds(const std::wstring& appName, DWORD minPriority, DWORD maxPriority) {
+	PendingChange& change = At(appName);
+	change.minPriority = minPriority ? ValueOp::Set : ValueOp::Clear;
+	change.minPriorityValue = minPriority;
+	change.maxPriority = maxPriority ? ValueOp::Set : ValueOp::Clear;
+	change.maxPriorityValue = maxPriority;
+	if (minPriority || maxPriority) change.create = true;
+}
+
+void WriteBatch::SetThreadRules(const std::wstring& appName, const std::wstring& rules) {
+	PendingChange& change = At(appName);
+	change.threadRules = rules.empty() ? ValueOp::Clear : ValueOp::Set;
+	change.threadRulesValue = rules;
+	if (!rules.empty()) change.create = true;
+}
+
+void WriteBatch::Clear() {
+	changes.clear();
+	index.clear();
+}
+
+typedef std::map<std::wstring, AppRecord, NoCaseLess> AppMap;
+
+static void ApplyChange(AppMap& apps, const PendingChange& change) {
+	if (change.remove) {
+		// as in the registry: PerfOptions goes, and the key with it unless something else is
+		// in it. These stores keep nothing else next to PerfOptions, and a key without it
+		// holds only other tools' values (Debugger and the like), so that one stays.
+		auto found = apps.find(change.name);
+		if (found != apps.end() && found->second.perfOptions) apps.erase(found);
+	}
+
+	auto it = apps.find(change.name);
+	if (change.create) {
+		if (it == apps.end())
+			it = apps.emplace(change.name, AppRecord{}).first;
+		if (it->second.name.empty())
+			it->second.name = change.name;
+		it->second.perfOptions = true;
+	}
+	if (it == apps.end() || !it->second.perfOptions)
+		return; // clearing values of a key that does not exist
+
+	AppRecord& record = it->second;
+	if (change.priority != ValueOp::Keep) {
+		record.hasPriority = change.priority == ValueOp::Set;
+		record.priority = change.priorityValue;
+	}
+	if (change.managed != ValueOp::Keep)
+		record.managed = change.managed == ValueOp::Set;
+	if (change.ioPriority != ValueOp::Keep) {
+		record.hasIoPriority = change.ioPriority == ValueOp::Set;
+		record.ioPriority = change.ioPriorityValue;
+	}
+	if (change.pagePriority != ValueOp::Keep) {
+		record.hasPagePriority = change.pagePriority == ValueOp::Set;
+		record.pagePriority = change.pagePriorityValue;
+	}
+	if (change.cpuSet != ValueOp::Keep)
+		record.cpuSet = change.cpuSet == ValueOp::Set ? change.cpuSetValue : std::wstring();
+	if (change.numaNode != ValueOp::Keep)
+		record.numaNode = change.numaNode == ValueOp::Set ? (int)change.numaNodeValue : -1;
+	if (change.cpuWeight != ValueOp::Keep)
+		record.cpuWeight = change.cpuWeight == ValueOp::Set ? change.cpuWeightValue : 0;
+	if (change.cpuQuota != ValueOp::Keep)
+		record.cpuQuota = change.cpuQuota == ValueOp::Set ? change.cpuQuotaValue : 0;
+	if (change.minPriority != ValueOp::Keep)
+		record.minPriority = change.minPriority == ValueOp::Set ? change.minPriorityValue : 0;
+	if (change.maxPriority != ValueOp::Keep)
+		record.maxPriority = change.maxPriority == ValueOp::Set ? change.maxPriorityValue : 0;
+	if (change.threadRules != ValueOp::Keep)
+		record.threadRules = change.threadRules == ValueOp::Set ? change.threadRulesValue : std::wstring();
+}
+
+std::vector<std::wstring> MemoryStore::GetApps() {
+	TRACE_SCOPE("store", "MemoryStore::GetApps");
+	std::lock_guard<std::mutex> guard(lock);
+	std::vector<std::wstring> appList;
+	appList.reserve(apps.size());
+	for (const auto& app : apps) {
+		if (IsIgnoredKey(app.first))
+			continue; // skip this key
+		appList.push_back(app.second.name);
+	}
+	return appList;
+}
+
+bool MemoryStore::GetPriority(const std::wstring& appName, DWORD& priority) {
+	TRACE_SCOPE("store", "MemoryStore::GetPriority");
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = apps.find(appName);
+	if (it == apps.end() || !it->second.perfOptions || !it->second.hasPriority) return false;
+	priority = it->second.priority;
+	return true;
+}
+
+// Single edits are one-change batches, so a FileStore journals them like any other
+bool MemoryStore::SetPriority(const std::wstring& appName, DWORD priority) {
+	TRACE_SCOPE("store", "MemoryStore::SetPriority");
+	WriteBatch batch;
+	batch.SetPriority(appName, priority);
+	std::lock_guard<std::mutex> guard(lock);
+	return CommitLocked(batch);
+}
+
+void MemoryStore::DefaultPriority(const std::wstring& appName) {
+	TRACE_SCOPE("store", "MemoryStore::DefaultPriority");
+	WriteBatch batch;
+	batch.DefaultPriority(appName);
+	std::lock_guard<std::mutex> guard(lock);
+	CommitLocked(batch);
+}
+
+bool MemoryStore::ClearPriority(const std::wstring& appName) {
+	TRACE_SCOPE("store", "MemoryStore::ClearPriority");
+	WriteBatch batch;
+	batch.ClearPriority(appName);
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = apps.find(appName);
+	if (it == apps.end() || !it->second.perfOptions) return false;
+	return CommitLocked(batch);
+}
+
+bool MemoryStore::Unmanage(const std::wstring& appName) {
+	TRACE_SCOPE("store", "MemoryStore::Unmanage");
+	WriteBatch batch;
+	batch.Unmanage(appName);
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = apps.find(appName);
+	if (it == apps.end() || !it->second.perfOptions) return false;
+	return CommitLocked(batch);
+}
+
+bool MemoryStore::RemoveApp(const std::wstring& appName) {
+	TRACE_SCOPE("store", "MemoryStore::RemoveApp");
+	WriteBatch batch;
+	batch.RemoveApp(appName);
+	std::lock_guard<std::mutex> guard(lock);
+	if (apps.find(appName) == apps.end()) return false;
+	return CommitLocked(batch);
+}
+
+bool MemoryStore::IsSetPriorityApp(const std::wstring& appName) {
+	TRACE_SCOPE("store", "MemoryStore::IsSetPriorityApp");
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = apps.find(appName);
+	return it != apps.end() && it->second.perfOptions && it->second.managed;
+}
+
+bool MemoryStore::ForEachApp(const std::function<bool(const AppRecord&)>& visit) {
+	TRACE_SCOPE("store", "MemoryStore::ForEachApp");
+	std::lock_guard<std::mutex> guard(lock);
+	for (const auto& app : apps) {
+		if (IsIgnoredKey(app.first))
+			continue;
+		if (!visit(app.second))
+			return false;
+	}
+	return true;
+}
+
+bool MemoryStore::Commit(const WriteBatch& batch) {
+	TRACE_SCOPE("store", "MemoryStore::Commit");
+	std::lock_guard<std::mutex> guard(lock);
+	return CommitLocked(batch);
+}
+
+bool MemoryStore::CommitLocked(const WriteBatch& batch) {
+	// keep what every touched key looked like, to put it back if persisting fails
+	std::vector<std::pair<std::wstring, std::optional<AppRecord>>> undo;
+	undo.reserve(batch.Size());
+	for (const auto& change : batch.Changes()) {
+		auto it = apps.find(change.name);
+		undo.emplace_back(change.name, it == apps.end() ? std::nullopt : std::optional<AppRecord>(it->second));
+		ApplyChange(apps, change);
+	}
+
+	if (Persist(batch))
+		return true;
+
+	for (auto& entry : undo) {
+		apps.erase(entry.first);
+		if (entry.second) apps.emplace(entry.first, *entry.second);
+	}
+	return false;
+}
+
+void MemoryStore::Put(const AppRecord& record) {
+	std::lock_guard<std::mutex> guard(lock);
+	apps[record.name] = record;
+	Changed();
+}
+
+size_t MemoryStore::Count() {
+	std::lock_guard<std::mutex> guard(lock);
+	return apps.size();
+}
+
+// Write data to a new file, or append it, and make sure it reached the disk before we
+// rename it anywhere or call it committed
+static bool WriteDurably(const std::filesystem::path& target, const std::string& data, bool append = false) {
+#ifdef _WIN32
+	FILE* file = _wfopen(target.c_str(), append ? L"ab" : L"wb");
+#else
+	FILE* file = fopen(target.c_str(), append ? "ab" : "wb");
+#endif
+	if (!file) return false;
+
+	bool ok = fwrite(data.data(), 1, data.size(), file) == data.size() && fflush(file) == 0;
+#ifdef _WIN32
+	ok = ok && _commit(_fileno(file)) == 0;
+#else
+	ok = ok && fsync(fileno(file)) == 0;
+#endif
+	return fclose(file) == 0 && ok;
+}
+
+static const char OpCode[] = { 'k', 's', 'c' }; // ValueOp in journal lines
+
+// name, remove, create, then one op-prefixed field per value: "s3" set to 3, "c" clear, "k" keep.
+// Fields missing at the end of a line mean keep, so older journals still replay.
+static std::string FormatJournalLine(const PendingChange& change) {
+	std::string line = WideToUtf8(change.name);
+	line += '\t'; line += change.remove ? '1' : '0';
+	line += '\t'; line += change.create ? '1' : '0';
+	line += '\t'; line += OpCode[(int)change.priority]; line += std::to_string(change.priorityValue);
+	line += '\t'; line += OpCode[(int)change.managed];
+	line += '\t'; line += OpCode[(int)change.cpuSet]; line += WideToUtf8(change.cpuSetValue);
+	line += '\t'; line += OpCode[(int)change.numaNode]; line += std::to_string(change.numaNodeValue);
+	line += '\t'; line += OpCode[(int)change.ioPriority]; line += std::to_string(change.ioPriorityValue);
+	line += '\t'; line += OpCode[(int)change.pagePriority]; line += std::to_string(change.pagePriorityValue);
+	line += '\t'; line += OpCode[(int)change.cpuWeight]; line += std::to_string(change.cpuWeightValue);
+	line += '\t'; line += OpCode[(int)change.cpuQuota]; line += std::to_string(change.cpuQuotaValue);
+	line += '\t'; line += OpCode[(int)change.minPriority]; line += std::to_string(change.minPriorityValue);
+	line += '\t'; line += OpCode[(int)change.maxPriority]; line += std::to_string(change.maxPriorityValue);
+	line += '\t'; line += OpCode[(int)change.threadRules]; line += WideToUtf8(change.threadRulesValue);
+	return line + '\n';
+}
+
+static bool ParseJournalLine(std::string line, PendingChange& change) {
+	if (!line.empty() && line.back() == '\r') line.pop_back();
+
+	std::vector<std::string> fields;
+	for (size_t start = 0, tab; start <= line.size(); start = tab + 1) {
+		tab = line.find('\t', start);
+		if (tab == std::string::npos) tab = line.size();
+		fields.push_back(line.substr(start, tab - start));
+	}
+	if (fields.size() < 5 || fields[0].empty()) return false;
+
+	auto op = [&](size_t index) {
+		char code = index < fields.size() && !fields[index].empty() ? fields[index][0] : 'k';
+		return code == 's' ? ValueOp::Set : code == 'c' ? ValueOp::Clear : ValueOp::Keep;
+	};
+	auto value = [&](size_t index) {
+		return index < fields.size() && fields[index].size() > 1 ? fields[index].substr(1) : std::string();
+	};
+
+	change = PendingChange{};
+	change.name = Utf8ToWide(fields[0]);
+	change.remove = fields[1] == "1";
+	change.create = fields[2] == "1";
+	change.priority = op(3);
+	change.priorityValue = (DWORD)strtoul(value(3).c_str(), nullptr, 10);
+	change.managed = op(4);
+	change.cpuSet = op(5);
+	change.cpuSetValue = Utf8ToWide(value(5));
+	change.numaNode = op(6);
+	change.numaNodeValue = (DWORD)strtoul(value(6).c_str(), nullptr, 10);
+	change.ioPriority = op(7);
+	change.ioPriorityValue = (DWORD)strtoul(value(7).c_str(), nullptr, 10);
+	change.pagePriority = op(8);
+	change.pagePriorityValue = (DWORD)strtoul(value(8).c_str(), nullptr, 10);
+	change.cpuWeight = op(9);
+	change.cpuWeightValue = (DWORD)strtoul(value(9).c_str(), nullptr, 10);
+	change.cpuQuota = op(10);
+	change.cpuQuotaValue = (DWORD)strtoul(value(10).c_str(), nullptr, 10);
+	change.minPriority = op(11);
+	change.minPriorityValue = (DWORD)strtoul(value(11).c_str(), nullptr, 10);
+	change.maxPriority = op(12);
+	change.maxPriorityValue = (DWORD)strtoul(value(12).c_str(), nullptr, 10);
+	change.threadRules = op(13);
+	change.threadRulesValue = Utf8ToWide(value(13));
+	return true;
+}
+
+FileStore::FileStore(const std::filesystem::path& path) : path(path) {
+	Load();
+}
+
+bool FileStore::Load() {
+	TRACE_SCOPE("store", "FileStore::Load");
+	std::error_code ec;
+	auto modified = std::filesystem::last_write_time(path, ec);
+	std::ifstream in(path, std::ios::binary);
+	std::error_code journalError;
+	if (!in && !std::filesystem::exists(JournalPath(), journalError)) return false; // a new store may have only a journal yet
+
+	std::map<std::wstring, AppRecord, NoCaseLess> loaded;
+	std::string line;
+	while (in && std::getline(in, line)) {
+		if (line.empty() || line[0] == '#' || line[0] == '\r') continue;
+
+		AppRecord record;
+		if (ParseEntryLine(Utf8ToWide(line), record)) {
+			loaded[record.name] = record;
+		}
+	}
+
+	// every batch that reached its "commit" line was promised: replay it. What follows the
+	// last one was torn by a crash and never committed; cut it off so the next append starts
+	// on a clean line.
+	std::vector<PendingChange> replay;
+	uintmax_t committed = 0, read = 0;
+	std::ifstream journal(JournalPath(), std::ios::binary);
+	while (journal && std::getline(journal, line)) {
+		read += line.size() + (journal.eof() ? 0 : 1);
+		PendingChange change;
+		if (line == "commit" && !journal.eof()) {
+			for (const auto& pending : replay)
+				ApplyChange(loaded, pending);
+			replay.clear();
+			committed = read;
+		}
+		else if (ParseJournalLine(line, change)) {
+			replay.push_back(change);
+		}
+	}
+	bool torn = journal.is_open() && read != committed;
+	journal.close();
+	if (torn) {
+		std::error_code cutError;
+		std::filesystem::resize_file(JournalPath(), committed, cutError);
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	apps.swap(loaded);
+	seen = modified;
+	journalSize = committed;
+	dirty = false;
+	return true;
+}
+
+FileStore::~FileStore() {
+	std::lock_guard<std::mutex> guard(lock);
+	if (autoSave && appended) CompactLocked(); // a store that only read leaves the files alone
+}
+
+std::filesystem::path FileStore::JournalPath() const {
+	std::filesystem::path journal = path;
+	journal += ".journal";
+	return journal;
+}
+
+bool FileStore::Persist(const WriteBatch& batch) {
+	TRACE_SCOPE("store", "FileStore::Persist");
+	if (!autoSave) {
+		dirty = true; // the caller saves once at the end
+		return true;
+	}
+
+	std::string journal;
+	for (const auto& change : batch.Changes())
+		journal += FormatJournalLine(change);
+	journal += "commit\n";
+	if (!WriteDurably(JournalPath(), journal, true)) {
+		std::error_code ec;
+		std::filesystem::resize_file(JournalPath(), journalSize, ec); // drop what part of it made it
+		return false;
+	}
+	journalSize += journal.size();
+	appended = true;
+
+	// committed once synced; a failed compaction leaves the journal to carry it
+	if (journalSize > JOURNAL_LIMIT) CompactLocked();
+	return true;
+}
+
+bool FileStore::ForEachApp(const std::function<bool(const AppRecord&)>& visit) {
+	std::error_code ec, journalError;
+	auto modified = std::filesystem::last_write_time(path, ec);
+	uintmax_t journal = std::filesystem::file_size(JournalPath(), journalError);
+	if (journalError) journal = 0;
+	bool reload;
+	{
+		std::lock_guard<std::mutex> guard(lock); // Load and commits move these; both lock themselves
+		reload = !dirty && ((!ec && modified != seen) || journal != journalSize);
+	}
+	if (reload) Load();
+	return MemoryStore::ForEachApp(visit);
+}
+
+bool FileStore::Save() {
+	std::lock_guard<std::mutex> guard(lock);
+	return SaveLocked();
+}
+
+void FileStore::Changed() {
+	if (autoSave) SaveLocked();
+	else dirty = true;
+}
+
+// Our copy lacks what another process appended since we last read or wrote the journal,
+// so rewriting the file from it would lose those batches; leave them in the journal instead
+bool FileStore::CompactLocked() {
+	std::error_code ec;
+	uintmax_t onDisk = std::filesystem::file_size(JournalPath(), ec);
+	if (ec || onDisk != journalSize) return false;
+	return SaveLocked();
+}
+
+bool FileStore::SaveLocked() {
+	TRACE_SCOPE("store", "FileStore::SaveLocked");
+	// write next to the target and rename over it, so readers never see half a file
+	std::filesystem::path temp = path;
+	temp += ".tmp";
+
+	std::string data;
+	data.reserve(apps.size() * 24);
+	for (const auto& app : apps) {
+		data += WideToUtf8(FormatEntryLine(app.second));
+		data += '\n';
+	}
+	if (!WriteDurably(temp, data)) return false;
+
+	std::error_code ec;
+	std::filesystem::rename(temp, path, ec);
+	if (ec) return false;
+	seen = std::filesystem::last_write_time(path, ec);
+	std::filesystem::remove(JournalPath(), ec); // all of it is in the file now
+	journalSize = 0;
+	appended = false;
+	dirty = false;
+	return true;
+}
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "platform.h"
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+constexpr auto IFEO_PATH = L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\Image File Execution Options"; // Registry path
+constexpr auto RegPriority = L"CpuPriorityClass";
+constexpr auto RegManaged = L"SetPriorityManaged";
+constexpr auto RegIoPriority = L"IoPriority";
+constexpr auto RegPagePriority = L"PagePriority";
+constexpr auto RegCpuSet = L"SetPriorityCpuSet";     // REG_SZ, Linux cpulist syntax
+constexpr auto RegNumaNode = L"SetPriorityNumaNode"; // REG_DWORD
+constexpr auto RegCpuWeight = L"SetPriorityCpuWeight"; // REG_DWORD, cgroup cpu.weight
+constexpr auto RegCpuQuota = L"SetPriorityCpuQuota";   // REG_DWORD, percent of one CPU
+constexpr auto RegMinPriority = L"SetPriorityMinPriority"; // REG_DWORD, CpuPriorityClass the governor may lower to
+constexpr auto RegMaxPriority = L"SetPriorityMaxPriority"; // REG_DWORD, ...and raise to
+constexpr auto RegThreadRules = L"SetPriorityThreads";     // REG_SZ, see ParseThreadRules
+
+extern const DWORD PriorityValues[7];
+const wchar_t* ConvertHexToName(DWORD priority);
+bool ConvertNameToHex(const std::wstring& name, DWORD& priority);
+int PriorityRank(DWORD priority); // index into PriorityValues, Idle 1 to Realtime 6; 0 for unknown values
+
+// IoPriority and PagePriority, indexed by their registry value
+extern const wchar_t* const IoPriorityNames[4];
+extern const wchar_t* const PagePriorityNames[6];
+bool ParseIoPriority(const std::wstring& text, DWORD& io);     // name or number
+bool ParsePagePriority(const std::wstring& text, DWORD& page);
+
+bool IsIgnoredKey(const std::wstring& keyName);
+
+// CPU lists as Linux writes them: "0-3,8,10-11". Parse accepts any order and overlap;
+// Format gives the sorted, merged form that is stored.
+constexpr unsigned MAX_CPUS = 1024;
+bool ParseCpuList(const std::wstring& text, std::vector<unsigned>& cpus);
+std::wstring FormatCpuList(const std::vector<unsigned>& cpus);
+bool NormalizeCpuList(const std::wstring& text, std::wstring& normalized); // "" stays ""
+
+// Classes for single threads of an app, picked by thread name (/proc/<pid>/task/<tid>/comm,
+// a Windows thread description): "RenderThread:High;Audio*:Realtime;Stream*:Below Normal".
+// Names may use '*' and '?' like app names, but not ',' or ';'; the priority follows the
+// last ':'. Format gives the stored form, in the order given, with priority names.
+struct ThreadRule {
+	std::wstring name;
+	DWORD priority = 0;
+};
+bool ParseThreadRules(const std::wstring& text, std::vector<ThreadRule>& rules);
+std::wstring FormatThreadRules(const std::vector<ThreadRule>& rules);
+bool NormalizeThreadRules(const std::wstring& text, std::wstring& normalized); // "" stays ""
+
+struct NoCaseLess {
+	bool operator()(const std::wstring& a, const std::wstring& b) const {
+		return _wcsicmp(a.c_str(), b.c_str()) < 0;
+	}
+};
+
+// One IFEO subkey as SetPriority sees it
+struct AppRecord {
+	std::wstring name;
+	bool perfOptions = false;  // PerfOptions subkey exists
+	bool hasPriority = false;  // CpuPriorityClass is set
+	DWORD priority = 0;
+	bool managed = false;      // SetPriorityManaged == 1
+	bool hasIoPriority = false;
+	DWORD ioPriority = 0;
+	bool hasPagePriority = false;
+	DWORD pagePriority = 0;
+	std::wstring cpuSet;       // normalized CPU list; empty: any CPU
+	int numaNode = -1;         // -1: no node binding
+	DWORD cpuWeight = 0;       // cgroup cpu.weight (1-10000); 0: derived from the priority
+	DWORD cpuQuota = 0;        // cgroup cpu.max in percent of one CPU; 0: no limit
+	DWORD minPriority = 0;     // governor bounds as CpuPriorityClass values; 0: the priority itself
+	DWORD maxPriority = 0;
+	std::wstring threadRules;  // normalized thread rules; empty: every thread gets the app's class
+	bool system = false;       // filled in by the GUI, not the store
+	uint64_t lastWrite = 0;    // change stamp (registry: newest FILETIME of the key and PerfOptions); 0: none
+};
+
+// Same stored values; the name, system and lastWrite are not compared
+bool SameSettings(const AppRecord& a, const AppRecord& b);
+
+// Text form used by FileStore and rule files: "name" for a bare key, otherwise ENTRY_LINE_SYNTAX
+constexpr auto ENTRY_LINE_SYNTAX = "name=Priority[,unmanaged][,io=IoPriority][,page=PagePriority][,cpus=LIST][,node=N]"
+	"[,weight=N][,quota=PERCENT][,min=Priority][,max=Priority][,threads=NAME:Priority;...]";
+bool ParseEntryLine(const std::wstring& line, AppRecord& record);
+std::wstring FormatEntryLine(const AppRecord& record);
+
+enum class ValueOp : unsigned char { Keep, Set, Clear };
+
+// Everything a batch does to one app. Removal happens first, so "remove, then set"
+// recreates PerfOptions from scratch.
+struct PendingChange {
+	std::wstring name;
+	bool remove = false;  // delete PerfOptions, then the IFEO key if nothing else is left in it
+	bool create = false;  // make sure PerfOptions exists
+	ValueOp priority = ValueOp::Keep;
+	DWORD priorityValue = 0;
+	ValueOp managed = ValueOp::Keep;
+	ValueOp ioPriority = ValueOp::Keep;
+	DWORD ioPriorityValue = 0;
+	ValueOp pagePriority = ValueOp::Keep;
+	DWORD pagePriorityValue = 0;
+	ValueOp cpuSet = ValueOp::Keep;
+	std::wstring cpuSetValue;
+	ValueOp numaNode = ValueOp::Keep;
+	DWORD numaNodeValue = 0;
+	ValueOp cpuWeight = ValueOp::Keep;
+	DWORD cpuWeightValue = 0;
+	ValueOp cpuQuota = ValueOp::Keep;
+	DWORD cpuQuotaValue = 0;
+	ValueOp minPriority = ValueOp::Keep;
+	DWORD minPriorityValue = 0;
+	ValueOp maxPriority = ValueOp::Keep;
+	DWORD maxPriorityValue = 0;
+	ValueOp threadRules = ValueOp::Keep;
+	std::wstring threadRulesValue;
+};
+
+// Collects writes and coalesces them per app, so each key is opened once per Commit
+// no matter how many calls touched it
+class WriteBatch {
+public:
+	void SetPriority(const std::wstring& appName, DWORD priority);
+	void DefaultPriority(const std::wstring& appName);
+	void ClearPriority(const std::wstring& appName);
+	void Unmanage(const std::wstring& appName);
+	void RemoveApp(const std::wstring& appName);
+	void SetIoPriority(const std::wstring& appName, int io);               // negative clears
+	void SetPagePriority(const std::wstring& appName, int page);           // negative clears
+	void SetCpuSet(const std::wstring& appName, const std::wstring& cpus); // normalized list; "" clears
+	void SetNumaNode(const std::wstring& appName, int node);               // negative clears
+	void SetCpuWeight(const std::wstring& appName, DWORD weight);          // 0 clears
+	void SetCpuQuota(const std::wstring& appName, DWORD percent);          // 0 clears
+	void SetPriorityBounds(const std::wstring& appName, DWORD minPriority, DWORD maxPriority); // 0 clears either
+	void SetThreadRules(const std::wstring& appName, const std::wstring& rules); // normalized; "" clears
+
+	const std::vector<PendingChange>& Changes() const { return changes; }
+	size_t Size() const { return changes.size(); }
+	bool Empty() const { return changes.empty(); }
+	void Clear();
+
+private:
+	PendingChange& At(const std::wstring& appName);
+
+	std::vector<PendingChange> changes;
+	std::unordered_map<std::wstring, size_t> index; // case-folded name -> changes slot
+};
+
+// Where the IFEO data lives. The GUI only talks to this interface, so the registry
+// can be swapped for an in-memory or file-backed tree when testing at scale.
+class PriorityStore {
+public:
+	virtual ~PriorityStore() = default;
+
+	virtual std::vector<std::wstring> GetApps() = 0;
+	virtual bool GetPriority(const std::wstring& appName, DWORD& priority) = 0;
+	virtual bool SetPriority(const std::wstring& appName, DWORD priority) = 0;
+	virtual void DefaultPriority(const std::wstring& appName) = 0;  // create PerfOptions and mark managed
+	virtual bool ClearPriority(const std::wstring& appName) = 0;    // drop CpuPriorityClass only
+	virtual bool Unmanage(const std::wstring& appName) = 0;         // drop SetPriorityManaged only
+	virtual bool RemoveApp(const std::wstring& appName) = 0;
+	virtual bool IsSetPriorityApp(const std::wstring& appName) = 0;
+
+	// All of the batch or none of it
+	virtual bool Commit(const WriteBatch& batch) = 0;
+
+	// Single pass over every key with both values read in the same visit.
+	// Return false from visit to stop early; visit must not call back into the store.
+	virtual bool ForEachApp(const std::function<bool(const AppRecord&)>& visit) = 0;
+	std::vector<AppRecord> LoadSnapshot();
+
+	// An earlier snapshot by app name, for ForEachChangedApp; nullptr when it is not in it
+	typedef std::function<const AppRecord*(const std::wstring&)> KnownApps;
+
+	// ForEachApp, except that a key whose stamp still matches its known record is passed
+	// on as that record without its values being read. Stores without stamps read everything.
+	virtual bool ForEachChangedApp(const KnownApps& known, const std::function<bool(const AppRecord&)>& visit) {
+		(void)known;
+		return ForEachApp(visit);
+	}
+};
+
+class MemoryStore : public PriorityStore {
+public:
+	std::vector<std::wstring> GetApps() override;
+	bool GetPriority(const std::wstring& appName, DWORD& priority) override;
+	bool SetPriority(const std::wstring& appName, DWORD priority) override;
+	void DefaultPriority(const std::wstring& appName) override;
+	bool ClearPriority(const std::wstring& appName) override;
+	bool Unmanage(const std::wstring& appName) override;
+	bool RemoveApp(const std::wstring& appName) override;
+	bool IsSetPriorityApp(const std::wstring& appName) override;
+	bool ForEachApp(const std::function<bool(const AppRecord&)>& visit) override;
+	bool Commit(const WriteBatch& batch) override;
+
+	void Put(const AppRecord& record); // seed a key as-is (synthetic trees, loading)
+	size_t Count();
+
+protected:
+	virtual void Changed() {} // called with the lock held after Put
+	virtual bool Persist(const WriteBatch&) { return true; } // lock held; false rolls the batch back
+
+	bool CommitLocked(const WriteBatch& batch); // Commit with the lock held; single edits use it too
+
+	std::mutex lock;
+	std::map<std::wstring, AppRecord, NoCaseLess> apps;
+};
+
+// MemoryStore mirrored to a UTF-8 text file, one FormatEntryLine per key. Each committed
+// batch is appended to "<file>.journal" and synced, so a write costs what it changes, not
+// the whole file; the file is rewritten and the journal dropped (compacted) by Save, on
+// close when this instance wrote, and once the journal passes JOURNAL_LIMIT. The last two
+// are skipped while another process has appended batches this one has not read. Load
+// replays every batch the journal holds up to its last "commit" line; a torn tail is cut off.
+class FileStore : public MemoryStore {
+public:
+	static constexpr uintmax_t JOURNAL_LIMIT = 1 << 20;
+
+	explicit FileStore(const std::filesystem::path& path);
+	~FileStore() override;
+
+	bool Load();
+	bool Save();
+	const std::filesystem::path& Path() const { return path; }
+	std::filesystem::path JournalPath() const;
+	void SetAutoSave(bool enabled) { autoSave = enabled; } // off: nothing is written until Save()
+
+	// The keys in memory. Edits other processes made to the file or journal since we last read
+	// or wrote them are loaded first, unless that would throw away changes not saved yet.
+	bool ForEachApp(const std::function<bool(const AppRecord&)>& visit) override;
+
+protected:
+	void Changed() override;
+	bool Persist(const WriteBatch& batch) override;
+	bool SaveLocked(); // rewrite the file, then drop the journal
+	bool CompactLocked(); // SaveLocked, unless another process appended to the journal meanwhile
+
+	std::filesystem::path path;
+	std::filesystem::file_time_type seen{};
+	uintmax_t journalSize = 0; // bytes of it we have replayed or written
+	bool appended = false;     // this instance wrote to the journal since the last compaction
+	bool autoSave = true;
+	bool dirty = false;        // changed in memory with autoSave off and not saved yet
+};
+
+#ifdef _WIN32
+// The real thing: HKLM\...\Image File Execution Options
+class RegistryStore : public PriorityStore {
+public:
+	std::vector<std::wstring> GetApps() override;
+	bool GetPriority(const std::wstring& appName, DWORD& priority) override;
+	bool SetPriority(const std::wstring& appName, DWORD priority) override;
+	void DefaultPriority(const std::wstring& appName) override;
+	bool ClearPriority(const std::wstring& appName) override;
+	bool Unmanage(const std::wstring& appName) override;
+	bool RemoveApp(const std::wstring& appName) override;
+	bool IsSetPriorityApp(const std::wstring& appName) override;
+	bool ForEachApp(const std::function<bool(const AppRecord&)>& visit) override;
+	bool ForEachChangedApp(const KnownApps& known, const std::function<bool(const AppRecord&)>& visit) override;
+	bool Commit(const WriteBatch& batch) override; // one KTM transaction; plain writes without KTM
+};
+#endif
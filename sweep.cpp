@@ -0,0 +1,200 @@
+#ifndef _WIN32
+#include "sweep.h"
+#include "trace.h"
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+constexpr size_t DIR_BUFFER = 64 * 1024;
+
+struct LinuxDirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1];
+};
+
+// Numeric directory name to a PID, 0 for anything else ("self", "net", ...)
+static int ParsePid(const char* name) {
+	int pid = 0;
+	for (; *name; ++name) {
+		if (*name < '0' || *name > '9') return 0;
+		pid = pid * 10 + (*name - '0');
+	}
+	return pid;
+}
+
+// Calls visit(pid) for every numeric entry of the open directory fd
+template <typename Visit>
+static void ForEachPid(int fd, char* buffer, Visit visit) {
+	lseek(fd, 0, SEEK_SET);
+	while (true) {
+		long length = syscall(SYS_getdents64, fd, buffer, DIR_BUFFER);
+		if (length <= 0) return;
+		for (long offset = 0; offset < length;) {
+			const LinuxDirent64* entry = reinterpret_cast<const LinuxDirent64*>(buffer + offset);
+			offset += entry->d_reclen;
+			if (int pid = ParsePid(entry->d_name))
+				visit(pid);
+		}
+	}
+}
+
+// What the kernel has for one thread, straight from its stat file
+struct ThreadState {
+	const char* comm;
+	size_t commLength;
+	int nice;
+	int threads;
+	int rtPriority;
+	int policy;
+};
+
+// comm only: the common case is a process no rule mentions, and comm is the smallest
+// file the kernel renders per process
+static size_t ReadComm(int dirFd, const char* path, char (&comm)[COMM_LEN + 2]) {
+	int fd = openat(dirFd, path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return 0;
+	ssize_t length = read(fd, comm, sizeof(comm));
+	close(fd);
+	if (length <= 0) return 0;
+	if (comm[length - 1] == '\n') --length;
+	return (size_t)length;
+}
+
+static bool ReadStat(int dirFd, const char* path, char (&stat)[1024], ThreadState& state) {
+	int fd = openat(dirFd, path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	ssize_t length = read(fd, stat, sizeof(stat) - 1);
+	close(fd);
+	if (length <= 0) return false;
+	stat[length] = '\0';
+
+	// "pid (comm) state ...": comm may itself hold spaces and ')', so it ends at the last one
+	char* begin = strchr(stat, '(');
+	char* end = strrchr(stat, ')');
+	if (!begin || !end || end < begin) return false;
+	state.comm = begin + 1;
+	state.commLength = size_t(end - begin - 1);
+
+	// field 3 starts two characters after ')'; we want 19 (nice), 20 (num_threads),
+	// 40 (rt_priority) and 41 (policy)
+	const char* field = end + 2;
+	for (int index = 3; index <= 41; ++index) {
+		if (index == 19) state.nice = atoi(field);
+		else if (index == 20) state.threads = atoi(field);
+		else if (index == 40) state.rtPriority = atoi(field);
+		else if (index == 41) { state.policy = atoi(field); return true; }
+
+		field = strchr(field, ' ');
+		if (!field) return false;
+		++field;
+	}
+	return false;
+}
+
+static bool HasClass(const ThreadState& state, const SchedClass& sched) {
+	switch (sched.policy)
+	{
+	case SchedPolicy::RoundRobin: return state.policy == SCHED_RR && state.rtPriority == sched.rtPriority;
+	case SchedPolicy::Idle: return state.policy == SCHED_IDLE && state.nice == sched.nice;
+	default: return state.policy == SCHED_OTHER && state.nice == sched.nice;
+	}
+}
+
+ProcSweeper::ProcSweeper(const char* root)
+	: procBuffer(new char[DIR_BUFFER]), taskBuffer(new char[DIR_BUFFER]) {
+	procFd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+ProcSweeper::~ProcSweeper() {
+	if (procFd >= 0) close(procFd);
+}
+
+// EnforceRule, skipping the scheduler syscalls when stat shows the class is already right.
+// stat's comm is the thread's own name, which is what thread rules match.
+static EnforceResult EnforceFromStat(int pid, int tid, const ThreadState& state, const RuleTable::Rule& rule) {
+	std::string_view threadName(state.comm, state.commLength);
+	const SchedClass* sched = rule.ThreadSched(threadName);
+	if (sched && !HasClass(state, *sched))
+		return EnforceRule(pid, tid, rule, threadName);
+	return MergeResults(ApplyIoPriority(tid, rule.ioprio), ApplyAffinity(pid, tid, rule));
+}
+
+EnforceResult ProcSweeper::SweepThreads(int pid, const RuleTable::Rule& rule) {
+	char path[32];
+	snprintf(path, sizeof(path), "%d/task", pid);
+	int taskFd = openat(procFd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (taskFd < 0) return EnforceResult::Gone;
+
+	EnforceResult result = EnforceResult::Gone;
+	ForEachPid(taskFd, taskBuffer.get(), [&](int tid) {
+		char stat[1024], statPath[24];
+		ThreadState state;
+		snprintf(statPath, sizeof(statPath), "%d/stat", tid);
+		if (ReadStat(taskFd, statPath, stat, state))
+			result = MergeResults(result, EnforceFromStat(pid, tid, state, rule));
+	});
+	close(taskFd);
+	return result;
+}
+
+EnforceStats ProcSweeper::Sweep(const RuleTable& rules, const ProcessHook& hook) {
+	TRACE_SCOPE("enforce", "ProcSweeper::Sweep");
+	EnforceStats stats;
+	if (procFd < 0) return stats;
+
+	ForEachPid(procFd, procBuffer.get(), [&](int pid) {
+		++stats.scanned;
+
+		char comm[COMM_LEN + 2], path[24];
+		snprintf(path, sizeof(path), "%d/comm", pid);
+		size_t length = ReadComm(procFd, path, comm);
+		if (length == 0) return; // exited meanwhile
+
+		std::string_view exe;
+		char exePath[PATH_MAX];
+		if (rules.HasPathRules()) {
+			snprintf(path, sizeof(path), "%d/exe", pid);
+			ssize_t exeLength = readlinkat(procFd, path, exePath, sizeof(exePath));
+			if (exeLength > 0 && exeLength < (ssize_t)sizeof(exePath))
+				exe = std::string_view(exePath, (size_t)exeLength);
+		}
+		const RuleTable::Rule* rule = rules.Find(std::string_view(comm, length), exe);
+		if (!rule) return;
+
+		char stat[1024];
+		ThreadState state;
+		snprintf(path, sizeof(path), "%d/stat", pid);
+		if (!ReadStat(procFd, path, stat, state)) return;
+
+		EnforceResult result = hook ? hook(pid, *rule) : EnforceResult::Unchanged;
+		if (result == EnforceResult::Gone) return;
+		if (result == EnforceResult::Held) {
+			++stats.held;
+			return;
+		}
+		++stats.matched;
+
+		// single-threaded: the stat we already read is the whole story
+		if (state.threads == 1)
+			result = MergeResults(result, EnforceFromStat(pid, pid, state, *rule));
+		else
+			result = MergeResults(result, SweepThreads(pid, *rule));
+
+		switch (result)
+		{
+		case EnforceResult::Applied: ++stats.applied; break;
+		case EnforceResult::Failed: ++stats.failed; break;
+		default: break;
+		}
+	});
+	return stats;
+}
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "enforce.h"
+
+#ifndef _WIN32
+#include <memory>
+
+// Reconciles every running process with the rules. Meant to run often on hosts with a
+// lot of processes, so nothing is allocated per process:
+// - /proc and /proc/<pid>/task are listed with getdents64 into buffers made once
+// - each process costs one read of /proc/<pid>/comm into a stack buffer; only the ones a
+//   rule matches also get /proc/<pid>/stat read, for policy, nice and thread count, so a
+//   process that already has its class costs no scheduler syscalls (I/O priority and
+//   affinity are not in stat and are checked with ioprio_get / sched_getaffinity)
+// - /proc/<pid>/exe is only read while some rule matches on the executable's path
+// root is only ever something else for the benchmark's synthetic tree.
+class ProcSweeper {
+public:
+	explicit ProcSweeper(const char* root = "/proc");
+	~ProcSweeper();
+	ProcSweeper(const ProcSweeper&) = delete;
+	ProcSweeper& operator=(const ProcSweeper&) = delete;
+
+	EnforceStats Sweep(const RuleTable& rules, const ProcessHook& hook = nullptr);
+
+private:
+	EnforceResult SweepThreads(int pid, const RuleTable::Rule& rule);
+
+	int procFd = -1;
+	std::unique_ptr<char[]> procBuffer;
+	std::unique_ptr<char[]> taskBuffer;
+};
+#endif
@@ -0,0 +1,100 @@
+#include "sysapps.h"
+#include "trace.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+std::vector<std::filesystem::path> DefaultSystemDirectories() {
+	std::vector<std::filesystem::path> directories;
+#ifdef _WIN32
+	WCHAR path[MAX_PATH];
+	if (GetSystemDirectoryW(path, MAX_PATH))
+		directories.emplace_back(path);
+	if (GetWindowsDirectoryW(path, MAX_PATH))
+		directories.push_back(std::filesystem::path(path) / L"SysWOW64");
+#else
+	directories.emplace_back("/usr/bin");
+	directories.emplace_back("/usr/sbin");
+#endif
+	return directories;
+}
+
+SystemAppClassifier::SystemAppClassifier(std::vector<std::filesystem::path> directories)
+	: directories(std::move(directories)) {
+}
+
+SystemAppClassifier::~SystemAppClassifier() {
+	CloseWatches();
+}
+
+void SystemAppClassifier::Refresh() {
+	if (stale || Changed())
+		Rebuild();
+}
+
+bool SystemAppClassifier::Contains(const std::wstring& exeName) const {
+	return names.find(FoldCase(exeName)) != names.end();
+}
+
+void SystemAppClassifier::CloseWatches() {
+#ifdef _WIN32
+	for (HANDLE watch : watches)
+		FindCloseChangeNotification(watch);
+	watches.clear();
+#else
+	if (watchFd >= 0) close(watchFd);
+	watchFd = -1;
+#endif
+}
+
+// Non-blocking poll of the change notifications armed by the last Rebuild
+bool SystemAppClassifier::Changed() {
+	bool changed = false;
+#ifdef _WIN32
+	for (HANDLE watch : watches) {
+		if (WaitForSingleObject(watch, 0) == WAIT_OBJECT_0) {
+			changed = true;
+			FindNextChangeNotification(watch);
+		}
+	}
+#else
+	if (watchFd >= 0) {
+		char events[4096];
+		while (read(watchFd, events, sizeof(events)) > 0)
+			changed = true;
+	}
+#endif
+	return changed;
+}
+
+void SystemAppClassifier::Rebuild() {
+	TRACE_SCOPE("sysapps", "SystemAppClassifier::Rebuild");
+	// arm the watches before listing, so a change made mid-listing is seen next time
+	CloseWatches();
+#ifdef _WIN32
+	for (const auto& directory : directories) {
+		HANDLE watch = FindFirstChangeNotificationW(directory.c_str(), FALSE,
+			FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME);
+		if (watch != INVALID_HANDLE_VALUE)
+			watches.push_back(watch);
+	}
+#else
+	watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watchFd >= 0) {
+		for (const auto& directory : directories)
+			inotify_add_watch(watchFd, directory.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+	}
+#endif
+
+	names.clear();
+	for (const auto& directory : directories) {
+		std::error_code ec;
+		for (std::filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+			names.insert(FoldCase(it->path().filename().wstring()));
+		}
+	}
+	stale = false;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "platform.h"
+#include <filesystem>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// System32 and SysWOW64 on Windows, the system binary directories elsewhere
+std::vector<std::filesystem::path> DefaultSystemDirectories();
+
+// Answers "does this exe ship with the OS" from a case-folded set of the file names in
+// the system directories. The set is built once and only rebuilt after a directory
+// change notification, so lookups never touch the filesystem.
+class SystemAppClassifier {
+public:
+	explicit SystemAppClassifier(std::vector<std::filesystem::path> directories);
+	~SystemAppClassifier();
+	SystemAppClassifier(const SystemAppClassifier&) = delete;
+	SystemAppClassifier& operator=(const SystemAppClassifier&) = delete;
+
+	void Refresh();                                  // rebuild if never built or a directory changed
+	bool Contains(const std::wstring& exeName) const; // lookup only, call Refresh first
+	void Invalidate() { stale = true; }
+	size_t Count() const { return names.size(); }
+
+private:
+	bool Changed();
+	void Rebuild();
+	void CloseWatches();
+
+	std::vector<std::filesystem::path> directories;
+	std::unordered_set<std::wstring> names;
+	bool stale = true;
+#ifdef _WIN32
+	std::vector<HANDLE> watches;
+#else
+	int watchFd = -1;
+#endif
+};
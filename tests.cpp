@@ -0,0 +1,367 @@
+// Unit checks for the parsers and planners the stores and the enforcer are built on, on
+// synthetic input so they run anywhere the portable build does:
+//   setpriority-tests   prints every failed check with its line, exits 1 if there was one
+#include "enforce.h"
+#include "matcher.h"
+#include "profiles.h"
+#include "regfile.h"
+#include "rules.h"
+#include "store.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static int Failures = 0;
+
+#define CHECK(condition) Check(condition, #condition, __LINE__)
+
+static void Check(bool ok, const char* text, int line) {
+	if (ok) return;
+	fprintf(stderr, "tests.cpp:%d: failed: %s\n", line, text);
+	++Failures;
+}
+
+static void EntryLines() {
+	AppRecord full;
+	full.name = L"game.exe";
+	full.perfOptions = full.managed = full.hasPriority = full.hasIoPriority = full.hasPagePriority = true;
+	full.priority = 3;
+	full.ioPriority = 1;
+	full.pagePriority = 4;
+	full.cpuSet = L"0-3,8";
+	full.numaNode = 1;
+	full.cpuWeight = 500;
+	full.cpuQuota = 150;
+	full.minPriority = 2;
+	full.threadRules = L"Render*:High;Audio:Realtime";
+
+	AppRecord unmanaged;
+	unmanaged.name = L"tool.exe";
+	unmanaged.perfOptions = unmanaged.hasPriority = true;
+	unmanaged.priority = 5;
+
+	AppRecord bare;
+	bare.name = L"debugged.exe";
+
+	for (const AppRecord& record : { full, unmanaged, bare }) {
+		AppRecord parsed;
+		CHECK(ParseEntryLine(FormatEntryLine(record), parsed));
+		CHECK(parsed.name == record.name);
+		CHECK(SameSettings(parsed, record));
+		CHECK(FormatEntryLine(parsed) == FormatEntryLine(record));
+	}
+
+	// as people write them: names for the values, spaces in the class names
+	AppRecord typed;
+	CHECK(ParseEntryLine(L"app.exe=Below Normal,io=Low,cpus=3,1-2,max=High", typed));
+	CHECK(typed.hasPriority && typed.priority == 5 && typed.managed);
+	CHECK(typed.hasIoPriority && typed.ioPriority == 1);
+	CHECK(typed.cpuSet == L"1-3");
+	CHECK(typed.maxPriority == 3);
+
+	AppRecord rejected;
+	CHECK(!ParseEntryLine(L"app.exe=Fastest", rejected));
+	CHECK(!ParseEntryLine(L"=High", rejected));
+}
+
+static std::filesystem::path TempPath(const char* name) {
+	return std::filesystem::temp_directory_path() / name;
+}
+
+static void RuleFiles() {
+	MemoryStore store;
+	AppRecord governed;
+	governed.name = L"game.exe";
+	governed.perfOptions = governed.managed = governed.hasPriority = true;
+	governed.priority = 3;
+	governed.minPriority = 2;
+	governed.maxPriority = 4;
+	governed.threadRules = L"Render*:High";
+	store.Put(governed);
+
+	std::stringstream file;
+	CHECK(ExportRules(store, file, false) == 1);
+	std::string header;
+	std::getline(file, header);
+	CHECK(header == std::string("# SetPriority rules: ") + ENTRY_LINE_SYNTAX);
+	for (const char* field : { ",min=", ",max=", ",threads=" }) // everything FormatEntryLine writes
+		CHECK(header.find(field) != std::string::npos);
+
+	file.seekg(0);
+	MemoryStore imported;
+	CHECK(ImportRules(imported, file).failed == 0);
+	std::vector<AppRecord> apps = imported.LoadSnapshot();
+	CHECK(apps.size() == 1 && SameSettings(apps[0], governed));
+}
+
+static void JournalReplay() {
+	std::filesystem::path file = TempPath("setpriority-tests.txt");
+	std::error_code ignored;
+	std::filesystem::remove(file, ignored);
+	std::filesystem::path journal;
+	{
+		FileStore store(file);
+		journal = store.JournalPath();
+		std::filesystem::remove(journal, ignored);
+		CHECK(store.SetPriority(L"a.exe", 3));
+		CHECK(store.SetPriority(L"b.exe", 5));
+		store.SetAutoSave(false); // leave the journal as a crash would, uncompacted
+	}
+	uintmax_t committed = std::filesystem::file_size(journal, ignored);
+	CHECK(committed > 0);
+
+	// a batch torn before its "commit" line
+	{
+		std::ofstream out(journal, std::ios::binary | std::ios::app);
+		out << "set\tc.exe\t3";
+	}
+	{
+		FileStore store(file);
+		DWORD priority = 0;
+		CHECK(store.GetPriority(L"a.exe", priority) && priority == 3);
+		CHECK(store.GetPriority(L"b.exe", priority) && priority == 5);
+		CHECK(store.Count() == 2);
+		CHECK(std::filesystem::file_size(journal, ignored) == committed);
+
+		// appends after the cut replay too
+		CHECK(store.SetPriority(L"c.exe", 1));
+		store.SetAutoSave(false);
+	}
+	{
+		FileStore store(file);
+		DWORD priority = 0;
+		CHECK(store.GetPriority(L"c.exe", priority) && priority == 1);
+		CHECK(store.Count() == 3);
+	}
+	std::filesystem::remove(file, ignored);
+	std::filesystem::remove(journal, ignored);
+}
+
+static void Removal() {
+	MemoryStore store;
+	AppRecord bare;
+	bare.name = L"debugged.exe"; // a key with only another tool's values
+	store.Put(bare);
+	CHECK(store.SetPriority(L"game.exe", 3));
+	CHECK(store.SetPriority(L"tool.exe", 5));
+
+	WriteBatch batch;
+	batch.RemoveApp(L"game.exe");
+	batch.RemoveApp(L"debugged.exe");
+	batch.RemoveApp(L"tool.exe");
+	batch.SetPriority(L"tool.exe", 1); // remove, then set: PerfOptions from scratch
+	CHECK(store.Commit(batch));
+	std::vector<std::wstring> names = store.GetApps();
+	CHECK(names == std::vector<std::wstring>({ L"debugged.exe", L"tool.exe" }));
+	DWORD priority = 0;
+	CHECK(store.GetPriority(L"tool.exe", priority) && priority == 1);
+
+	// the single call removes the same
+	CHECK(store.RemoveApp(L"tool.exe"));
+	CHECK(store.RemoveApp(L"debugged.exe"));
+	CHECK(store.GetApps() == std::vector<std::wstring>({ L"debugged.exe" }));
+}
+
+static void SharedFile() {
+	std::filesystem::path file = TempPath("setpriority-tests-shared.txt");
+	std::error_code ignored;
+	std::filesystem::remove(file, ignored);
+	std::filesystem::path journal = file;
+	journal += ".journal";
+	std::filesystem::remove(journal, ignored);
+
+	// reading, even a store that does not exist yet, writes nothing
+	{
+		FileStore reader(file);
+		CHECK(reader.LoadSnapshot().empty());
+	}
+	CHECK(!std::filesystem::exists(file) && !std::filesystem::exists(journal));
+
+	// two instances, as two command lines would be: closing one must not drop the other's batch
+	{
+		FileStore first(file);
+		CHECK(first.SetPriority(L"a.exe", 3));
+		{
+			FileStore second(file);
+			CHECK(second.SetPriority(L"b.exe", 5));
+			second.SetAutoSave(false); // still running
+		}
+	}
+	{
+		FileStore store(file);
+		DWORD priority = 0;
+		CHECK(store.GetPriority(L"a.exe", priority) && priority == 3);
+		CHECK(store.GetPriority(L"b.exe", priority) && priority == 5);
+	}
+	std::filesystem::remove(file, ignored);
+	std::filesystem::remove(journal, ignored);
+}
+
+static void MatcherPrecedence() {
+	NameMatcher names;
+	names.Add("game", 1);
+	names.Add("g*", 2);
+	names.Add("gam*", 3);
+	names.Add("*e", 4);
+	names.Add("game?", 5);
+	names.Compile();
+	CHECK(names.Match("game") == 1);        // exact over every pattern
+	CHECK(names.Match("GAME") == 1);        // case folded
+	CHECK(names.Match("gamer") == 5);       // the most literal bytes: "game?" has 4, "gam*" 3
+	CHECK(names.Match("gambit") == 3);
+	CHECK(names.Match("go") == 2);
+	CHECK(names.Match("hue") == 4);
+	CHECK(names.Match("other") == NameMatcher::NONE);
+
+	NameMatcher paths(false);
+	paths.Add("/opt/*", 1);
+	paths.Add("/opt/game/*", 2);
+	paths.Compile();
+	CHECK(paths.Match("/opt/game/bin/game") == 2);
+	CHECK(paths.Match("/opt/tool") == 1);
+	CHECK(paths.Match("/OPT/game/bin/game") == NameMatcher::NONE);
+
+	// the same through RuleTable: a path rule beats a name rule, a directory covers what is under it
+	std::vector<AppRecord> apps(3);
+	apps[0].name = L"game.exe";
+	apps[1].name = L"/opt/game/";
+	apps[2].name = L"/opt/";
+	for (auto& app : apps) {
+		app.perfOptions = app.managed = app.hasPriority = true;
+		app.priority = 2;
+	}
+	RuleTable rules;
+	rules.Build(apps);
+	const RuleTable::Rule* rule = rules.Find("game", "/opt/game/bin/game");
+	CHECK(rule && rule->key == "/opt/game/*");
+	rule = rules.Find("game", "/opt/other/game");
+	CHECK(rule && rule->key == "/opt/*");
+	rule = rules.Find("game", "/usr/bin/game");
+	CHECK(rule && rule->key == "game");
+	rule = rules.Find("game", "/Opt/game/game");
+	CHECK(rule && rule->key == "game");
+}
+
+static void RegFileParser() {
+	std::filesystem::path file = TempPath("setpriority-tests.reg");
+	const std::wstring root = std::wstring(L"[HKEY_LOCAL_MACHINE\\") + IFEO_PATH + L"\\";
+	std::wstring text = L"\uFEFFWindows Registry Editor Version 5.00\r\n\r\n";
+	text += root + L"game.exe]\r\n";
+	text += L"\"Debugger\"=\"C:\\\\tools\\\\dbg.exe\"\r\n\r\n";
+	text += root + L"game.exe\\PerfOptions]\r\n";
+	// a multi-line value whose continuation lines must not be read as values or keys
+	text += L"\"Other\"=hex(7):22,00,5b,00,\\\r\n";
+	text += L"  22,00,3d,00,00,00,00,00\r\n";
+	text += L"\"CpuPriorityClass\"=dword:00000003\r\n";
+	text += L"\"SetPriorityManaged\"=dword:00000001\r\n";
+	text += L"\"SetPriorityCpuSet\"=\"2,0-1\"\r\n\r\n";
+	text += root + L"bare.exe]\r\n\r\n";
+	text += L"[HKEY_LOCAL_MACHINE\\SOFTWARE\\Elsewhere\\other.exe\\PerfOptions]\r\n";
+	text += L"\"CpuPriorityClass\"=dword:00000001\r\n";
+
+	std::string bytes;
+	for (wchar_t c : text) { // all BMP
+		bytes += char(c & 0xFF);
+		bytes += char((c >> 8) & 0xFF);
+	}
+	{
+		std::ofstream out(file, std::ios::binary);
+		out.write(bytes.data(), (std::streamsize)bytes.size());
+	}
+
+	RegFileStore dump(file);
+	CHECK(dump.Load());
+	CHECK(dump.Count() == 2);
+	std::vector<AppRecord> apps = dump.LoadSnapshot();
+	for (const auto& app : apps) {
+		if (app.name == L"game.exe") {
+			CHECK(app.perfOptions && app.managed);
+			CHECK(app.hasPriority && app.priority == 3);
+			CHECK(app.cpuSet == L"0-2");
+		}
+		else {
+			CHECK(app.name == L"bare.exe");
+			CHECK(!app.perfOptions);
+		}
+	}
+	CHECK(!dump.SetPriority(L"game.exe", 1)); // read-only
+
+	std::error_code ignored;
+	std::filesystem::remove(file, ignored);
+}
+
+static AppRecord Managed(const wchar_t* name, DWORD priority) {
+	AppRecord app;
+	app.name = name;
+	app.perfOptions = app.managed = app.hasPriority = true;
+	app.priority = priority;
+	return app;
+}
+
+static void ProfileDiff() {
+	std::vector<AppRecord> current = {
+		Managed(L"kept.exe", 3),
+		Managed(L"changed.exe", 3),
+		Managed(L"dropped.exe", 5),
+	};
+	AppRecord bare;
+	bare.name = L"bare.exe";
+	current.push_back(bare);
+	AppRecord foreign = Managed(L"foreign.exe", 1);
+	foreign.managed = false; // set by someone else: not ours to release
+	current.push_back(foreign);
+
+	std::vector<AppRecord> profile = {
+		Managed(L"KEPT.EXE", 3),       // names compare without case
+		Managed(L"changed.exe", 1),
+		Managed(L"changed.exe", 6),    // the last rule for an app wins
+		Managed(L"bare.exe", 2),
+		Managed(L"new.exe", 4),
+	};
+
+	WriteBatch batch;
+	ProfileSwitch plan = PlanProfileSwitch(current, profile, batch);
+	CHECK(plan.unchanged == 1);
+	CHECK(plan.changed == 1);
+	CHECK(plan.added == 2);
+	CHECK(plan.released == 1);
+	CHECK(plan.Writes() == 4);
+	CHECK(batch.Size() == 4);
+
+	MemoryStore store;
+	for (const auto& app : current)
+		store.Put(app);
+	CHECK(store.Commit(batch));
+	DWORD priority = 0;
+	CHECK(store.GetPriority(L"changed.exe", priority) && priority == 6);
+	CHECK(store.GetPriority(L"bare.exe", priority) && priority == 2);
+	CHECK(store.GetPriority(L"new.exe", priority) && priority == 4);
+	CHECK(store.GetPriority(L"foreign.exe", priority) && priority == 1);
+	CHECK(!store.IsSetPriorityApp(L"dropped.exe"));
+	CHECK(store.GetApps().size() == 6); // released, not removed
+
+	// switching again to the same profile writes nothing
+	WriteBatch again;
+	plan = PlanProfileSwitch(store.LoadSnapshot(), profile, again);
+	CHECK(plan.Writes() == 0 && again.Empty());
+}
+
+int main() {
+	EntryLines();
+	RuleFiles();
+	JournalReplay();
+	Removal();
+	SharedFile();
+	MatcherPrecedence();
+	RegFileParser();
+	ProfileDiff();
+	if (Failures) {
+		fprintf(stderr, "%d check(s) failed\n", Failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+
+static_assert((TRACE_CAPACITY & (TRACE_CAPACITY - 1)) == 0, "TRACE_CAPACITY must be a power of two");
+
+// A seqlock per slot: odd while its writer fills it, 2 * (ticket + 1) once published.
+// A reader copies the event and keeps it only if the sequence did not move meanwhile.
+struct TraceSlot {
+	std::atomic<uint64_t> sequence{ 0 };
+	TraceEvent event{};
+};
+
+static std::atomic<bool> Enabled{ false };
+static std::atomic<uint64_t> NextTicket{ 0 };
+static std::atomic<uint32_t> NextThread{ 0 };
+static TraceSlot Ring[TRACE_CAPACITY];
+
+void EnableTracing(bool enabled) {
+	Enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool TracingEnabled() {
+	return Enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t TraceNow() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void RecordTrace(const char* category, const char* name, uint64_t startNs, uint64_t durationNs) {
+	thread_local uint32_t thread = NextThread.fetch_add(1, std::memory_order_relaxed) + 1;
+
+	uint64_t ticket = NextTicket.fetch_add(1, std::memory_order_relaxed);
+	TraceSlot& slot = Ring[ticket & (TRACE_CAPACITY - 1)];
+	slot.sequence.store(2 * ticket + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.event = TraceEvent{ category, name, startNs, durationNs, thread };
+	slot.sequence.store(2 * (ticket + 1), std::memory_order_release);
+}
+
+void ClearTrace() {
+	for (TraceSlot& slot : Ring)
+		slot.sequence.store(0, std::memory_order_relaxed);
+}
+
+std::vector<TraceEvent> CollectTrace() {
+	uint64_t end = NextTicket.load(std::memory_order_acquire);
+	uint64_t begin = end > TRACE_CAPACITY ? end - TRACE_CAPACITY : 0;
+
+	std::vector<TraceEvent> events;
+	events.reserve(size_t(end - begin));
+	for (uint64_t ticket = begin; ticket < end; ++ticket) {
+		const TraceSlot& slot = Ring[ticket & (TRACE_CAPACITY - 1)];
+		uint64_t before = slot.sequence.load(std::memory_order_acquire);
+		if (before != 2 * (ticket + 1)) continue; // cleared, still being written, or overwritten
+		TraceEvent event = slot.event;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) == before)
+			events.push_back(event);
+	}
+	return events;
+}
+
+static void WriteJsonString(std::ostream& out, const char* text) {
+	out << '"';
+	for (; *text; ++text) {
+		if (*text == '"' || *text == '\\') out << '\\';
+		out << *text;
+	}
+	out << '"';
+}
+
+// Nanoseconds as microseconds with three decimals; the stream's default 6 significant
+// digits would print anything past a second as 1.23457e+06
+static void WriteMicroseconds(std::ostream& out, uint64_t ns) {
+	char text[32];
+	snprintf(text, sizeof(text), "%llu.%03u", (unsigned long long)(ns / 1000), unsigned(ns % 1000));
+	out << text;
+}
+
+void WriteChromeTrace(const std::vector<TraceEvent>& events, std::ostream& out) {
+	// complete ("X") events, timestamps in microseconds from the first event
+	uint64_t origin = UINT64_MAX;
+	for (const TraceEvent& event : events)
+		origin = std::min(origin, event.startNs);
+
+	out << "{\"traceEvents\":[";
+	bool first = true;
+	for (const TraceEvent& event : events) {
+		out << (first ? "\n" : ",\n") << "{\"name\":";
+		WriteJsonString(out, event.name);
+		out << ",\"cat\":";
+		WriteJsonString(out, event.category);
+		out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":";
+		WriteMicroseconds(out, event.startNs - origin);
+		out << ",\"dur\":";
+		WriteMicroseconds(out, event.durationNs);
+		out << '}';
+		first = false;
+	}
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+std::vector<TraceStat> SummarizeTrace(const std::vector<TraceEvent>& events) {
+	std::map<std::pair<std::string, std::string>, std::vector<uint64_t>> durations;
+	for (const TraceEvent& event : events)
+		durations[{ event.category, event.name }].push_back(event.durationNs);
+
+	std::vector<TraceStat> stats;
+	for (auto& [key, samples] : durations) {
+		std::sort(samples.begin(), samples.end());
+		TraceStat stat;
+		stat.category = key.first;
+		stat.name = key.second;
+		stat.count = samples.size();
+		stat.p50Ns = samples[(samples.size() - 1) / 2];
+		stat.p99Ns = samples[std::min(samples.size() - 1, size_t(0.99 * double(samples.size() - 1) + 0.5))];
+		for (uint64_t sample : samples) stat.totalNs += sample;
+		stats.push_back(std::move(stat));
+	}
+	std::sort(stats.begin(), stats.end(), [](const TraceStat& a, const TraceStat& b) { return a.totalNs > b.totalNs; });
+	return stats;
+}
+
+std::wstring FormatTraceStat(const TraceStat& stat) {
+	wchar_t numbers[128];
+	swprintf(numbers, 128, L": %zux, p50 %.3f ms, p99 %.3f ms, total %.3f ms", stat.count,
+		double(stat.p50Ns) / 1e6, double(stat.p99Ns) / 1e6, double(stat.totalNs) / 1e6);
+	std::wstring line(stat.category.begin(), stat.category.end()); // names are ASCII
+	line += L'/';
+	line.append(stat.name.begin(), stat.name.end());
+	return line + numbers;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Timing of store calls, system-app probes, list population and enforcement, for finding
+// out where a slow refresh goes. Events land in a fixed ring of the last TRACE_CAPACITY:
+// a writer claims a slot with one atomic add and publishes it with a sequence number, so
+// recording never locks or allocates, and while tracing is off a scope costs one load.
+// The ring can be written out in Chrome's trace-event format (chrome://tracing, Perfetto)
+// or summarized per name.
+
+constexpr size_t TRACE_CAPACITY = 1 << 16;
+
+struct TraceEvent {
+	const char* category; // string literals only: events keep the pointer
+	const char* name;
+	uint64_t startNs;     // steady clock
+	uint64_t durationNs;
+	uint32_t thread;      // small per-thread number, 1 for the first thread that traced
+};
+
+struct TraceStat {
+	std::string category;
+	std::string name;
+	size_t count = 0;
+	uint64_t p50Ns = 0;
+	uint64_t p99Ns = 0;
+	uint64_t totalNs = 0;
+};
+
+void EnableTracing(bool enabled);
+bool TracingEnabled();
+uint64_t TraceNow();
+void RecordTrace(const char* category, const char* name, uint64_t startNs, uint64_t durationNs);
+void ClearTrace();
+
+std::vector<TraceEvent> CollectTrace(); // oldest first; slots being written are skipped
+void WriteChromeTrace(const std::vector<TraceEvent>& events, std::ostream& out);
+std::vector<TraceStat> SummarizeTrace(const std::vector<TraceEvent>& events); // most total time first
+std::wstring FormatTraceStat(const TraceStat& stat); // "store/Commit: 3x, p50 1.20 ms, p99 1.50 ms, total 3.60 ms"
+
+class TraceScope {
+public:
+	TraceScope(const char* category, const char* name)
+		: category(category), name(name), start(TracingEnabled() ? TraceNow() : 0) {
+	}
+	~TraceScope() {
+		if (start) RecordTrace(category, name, start, TraceNow() - start);
+	}
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* category;
+	const char* name;
+	uint64_t start;
+};
+
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+#define TRACE_SCOPE(category, name) TraceScope TRACE_JOIN(traceScope, __LINE__)(category, name)
@@ -0,0 +1,272 @@
+#ifndef _WIN32
+#include "watchdog.h"
+#include "trace.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+static uint64_t SteadyNs() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool ReadSmallFile(const char* path, char* buffer, size_t size) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	ssize_t length = read(fd, buffer, size - 1);
+	close(fd);
+	if (length <= 0) return false;
+	buffer[length] = '\0';
+	return true;
+}
+
+// The fields of a thread's stat file the watchdog needs
+struct ThreadStat {
+	uint64_t cpuTicks = 0;   // 14 utime + 15 stime
+	int nice = 0;            // 19
+	uint64_t startTime = 0;  // 22
+	int processor = -1;      // 39
+	int policy = 0;          // 41
+};
+
+static bool ReadThreadStat(const char* path, ThreadStat& state) {
+	char stat[1024];
+	if (!ReadSmallFile(path, stat, sizeof(stat))) return false;
+	const char* end = strrchr(stat, ')'); // comm may hold spaces and ')'
+	if (!end) return false;
+
+	// field 3 starts two characters after ')'
+	const char* field = end + 2;
+	for (int index = 3; index <= 41; ++index) {
+		switch (index)
+		{
+		case 14: case 15: state.cpuTicks += strtoull(field, nullptr, 10); break;
+		case 19: state.nice = atoi(field); break;
+		case 22: state.startTime = strtoull(field, nullptr, 10); break;
+		case 39: state.processor = atoi(field); break;
+		case 41: state.policy = atoi(field); return true;
+		}
+		field = strchr(field, ' ');
+		if (!field) return false;
+		++field;
+	}
+	return false;
+}
+
+// The class a thread runs at as far as the watchdog cares: Realtime, High or 0 for neither
+static DWORD RunningClass(const ThreadStat& state) {
+	if (state.policy == SCHED_FIFO || state.policy == SCHED_RR) return 4;
+	if (state.policy == SCHED_OTHER && state.nice <= -10) return 3;
+	return 0;
+}
+
+static bool MayRunHigh(const RuleTable::Rule& rule) {
+	if (PriorityRank(rule.maxPriority) >= PriorityRank(3)) return true;
+	for (const auto& thread : rule.threadClasses) {
+		if (PriorityRank(thread.priority) >= PriorityRank(3)) return true;
+	}
+	return false;
+}
+
+bool StarvationWatchdog::Available() {
+	std::vector<uint64_t> delays;
+	return ReadDelays(delays);
+}
+
+bool StarvationWatchdog::ReadDelays(std::vector<uint64_t>& delays) {
+	delays.clear();
+	if (source == Source::Unknown || source == Source::SchedStat) {
+		// "cpuN yld_count 0 sched_count sched_goidle ttwu_count ttwu_local rq_cpu_time run_delay pcount"
+		if (FILE* file = fopen("/proc/schedstat", "r")) {
+			char line[512];
+			while (fgets(line, sizeof(line), file)) {
+				if (strncmp(line, "cpu", 3) != 0 || line[3] < '0' || line[3] > '9') continue;
+				char* field = nullptr;
+				unsigned long cpu = strtoul(line + 3, &field, 10);
+				if (cpu >= MAX_CPUS) continue;
+				uint64_t value = 0;
+				for (int index = 0; index < 8; ++index)
+					value = strtoull(field, &field, 10);
+				if (delays.size() <= cpu) delays.resize(cpu + 1);
+				delays[cpu] = value;
+			}
+			fclose(file);
+			if (!delays.empty()) {
+				source = Source::SchedStat;
+				return true;
+			}
+		}
+	}
+	if (source == Source::Unknown || source == Source::Pressure) {
+		// "some avg10=0.00 avg60=0.00 avg300=0.00 total=MICROSECONDS"
+		char text[256];
+		const char* total = ReadSmallFile("/proc/pressure/cpu", text, sizeof(text)) ? strstr(text, "total=") : nullptr;
+		if (total && strncmp(text, "some", 4) == 0) {
+			delays.push_back(strtoull(total + 6, nullptr, 10) * 1000);
+			source = Source::Pressure;
+			return true;
+		}
+	}
+	if (source == Source::Unknown) source = Source::None;
+	return false;
+}
+
+void StarvationWatchdog::FindHogs(const RuleTable& rules, uint64_t elapsedNs, std::vector<Hog>& hogs) {
+	static const long ticks = sysconf(_SC_CLK_TCK);
+	const uint64_t tickNs = 1000000000ull / (uint64_t)(ticks > 0 ? ticks : 100);
+	DIR* proc = opendir("/proc");
+	if (!proc) return;
+
+	while (dirent* entry = readdir(proc)) {
+		int pid = atoi(entry->d_name);
+		if (pid <= 0 || Holds(pid)) continue;
+
+		// only apps a rule may put at High or Realtime, or that have a thread rule for it
+		std::string name;
+		const RuleTable::Rule* rule = MatchPid(rules, pid, &name);
+		if (!rule || !MayRunHigh(*rule)) continue;
+
+		char path[48];
+		snprintf(path, sizeof(path), "/proc/%d/task", pid);
+		DIR* tasks = opendir(path);
+		if (!tasks) continue;
+		while (dirent* task = readdir(tasks)) {
+			int tid = atoi(task->d_name);
+			if (tid <= 0) continue;
+			ThreadStat state;
+			snprintf(path, sizeof(path), "/proc/%d/task/%d/stat", pid, tid);
+			if (!ReadThreadStat(path, state)) continue;
+
+			uint64_t cpuNs = state.cpuTicks * tickNs;
+			Thread& thread = threads[tid];
+			bool known = thread.pass != 0 && cpuNs >= thread.cpuNs;
+			uint64_t used = known ? cpuNs - thread.cpuNs : 0;
+			thread.cpuNs = cpuNs;
+			thread.pass = pass;
+
+			DWORD priority = RunningClass(state);
+			if (!known || !elapsedNs || !priority) continue;
+			double share = double(used) / double(elapsedNs);
+			if (share < config.hogShare) continue;
+
+			Hog hog;
+			hog.pid = pid;
+			hog.cpu = state.processor;
+			hog.priority = priority;
+			hog.used = share;
+			hog.name = name;
+			hogs.push_back(std::move(hog));
+		}
+		closedir(tasks);
+	}
+	closedir(proc);
+
+	for (auto it = threads.begin(); it != threads.end();) {
+		if (it->second.pass != pass) it = threads.erase(it);
+		else ++it;
+	}
+}
+
+void StarvationWatchdog::Restore(const RuleTable& rules, uint64_t nowNs, std::vector<WatchdogEvent>& events) {
+	for (auto it = demoted.begin(); it != demoted.end();) {
+		if (nowNs < it->second.untilNs) {
+			++it;
+			continue;
+		}
+
+		int pid = it->first;
+		char path[32];
+		ThreadStat state;
+		snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+		const RuleTable::Rule* rule = nullptr;
+		if (ReadThreadStat(path, state) && state.startTime == it->second.startTime)
+			rule = MatchPid(rules, pid);
+
+		// gone, or no longer a rule to put back: nothing to do. Threads the rule does not
+		// give a class keep the one they were demoted to.
+		SchedClass sched;
+		if (rule && (MapPriorityClass(rule->priority, sched) || (rule->HasThreadRules() && MapPriorityClass(config.demoteTo, sched)))) {
+			WatchdogEvent event;
+			event.pid = pid;
+			event.name = it->second.name;
+			event.from = config.demoteTo;
+			event.to = rule->priority;
+			EnforceResult result = ApplySchedClassToPid(pid, sched, rule);
+			event.kind = result == EnforceResult::Failed ? WatchdogEvent::Failed : WatchdogEvent::Restored;
+			if (result != EnforceResult::Gone) events.push_back(std::move(event));
+		}
+		it = demoted.erase(it);
+	}
+}
+
+std::vector<WatchdogEvent> StarvationWatchdog::Sample(const RuleTable& rules) {
+	TRACE_SCOPE("watchdog", "StarvationWatchdog::Sample");
+	std::vector<WatchdogEvent> events;
+	++pass;
+	uint64_t now = SteadyNs();
+	std::vector<uint64_t> delays;
+	if (!ReadDelays(delays)) return events;
+
+	bool first = sampledNs == 0 || delays.size() != lastDelays.size();
+	uint64_t elapsed = first ? 0 : now - sampledNs;
+	std::vector<Hog> hogs;
+	FindHogs(rules, elapsed, hogs);
+	Restore(rules, now, events);
+
+	if (first) starved.assign(delays.size(), 0);
+	for (size_t cpu = 0; cpu < delays.size() && !first; ++cpu) {
+		uint64_t waited = delays[cpu] >= lastDelays[cpu] ? delays[cpu] - lastDelays[cpu] : 0;
+		double delay = elapsed ? double(waited) / double(elapsed) : 0;
+		if (delay < config.starvedShare) {
+			starved[cpu] = 0;
+			continue;
+		}
+		if (++starved[cpu] < config.holdSamples) continue;
+
+		// the busiest High or Realtime thread on that CPU, or anywhere without per-CPU numbers
+		const Hog* offender = nullptr;
+		for (const Hog& hog : hogs) {
+			if ((!PerCpu() || hog.cpu == (int)cpu) && !Holds(hog.pid) && (!offender || hog.used > offender->used))
+				offender = &hog;
+		}
+		if (!offender) continue;
+		starved[cpu] = 0;
+
+		WatchdogEvent event;
+		event.pid = offender->pid;
+		event.name = offender->name;
+		event.from = offender->priority;
+		event.to = config.demoteTo;
+		event.cpu = PerCpu() ? (int)cpu : -1;
+		event.delay = delay;
+		event.used = offender->used;
+
+		char path[32];
+		ThreadStat state;
+		snprintf(path, sizeof(path), "/proc/%d/stat", offender->pid);
+		SchedClass sched;
+		if (!ReadThreadStat(path, state) || !MapPriorityClass(config.demoteTo, sched)) continue;
+		EnforceResult result = ApplySchedClassToPid(offender->pid, sched);
+		if (result == EnforceResult::Gone) continue;
+		if (result == EnforceResult::Failed) {
+			event.kind = WatchdogEvent::Failed;
+		}
+		else {
+			Demotion& demotion = demoted[offender->pid];
+			demotion.startTime = state.startTime;
+			demotion.untilNs = now + (uint64_t)config.cooldownSeconds * 1000000000ull;
+			demotion.name = offender->name;
+		}
+		events.push_back(std::move(event));
+	}
+
+	lastDelays = std::move(delays);
+	sampledNs = now;
+	return events;
+}
+#endif
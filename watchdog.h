@@ -0,0 +1,90 @@
+#pragma once
+
+#include "enforce.h"
+
+#ifndef _WIN32
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Guards against a managed app whose High or Realtime class lets it starve the machine.
+// Every interval it reads how long runnable tasks waited for each CPU (run_delay in
+// /proc/schedstat) and what the threads of managed processes ran on. A CPU whose waiting
+// time stays above starvedShare of the interval for holdSamples samples in a row, while a
+// thread at High or Realtime used at least hogShare of it, gets that thread's process
+// demoted to demoteTo for cooldownSeconds; then the rule's class is put back.
+// Kernels without schedstats have no /proc/schedstat; there the "some" line of
+// /proc/pressure/cpu stands in for all CPUs at once and a hog on any CPU is the offender.
+// Only processes a rule matches are ever touched: kernel threads and the system's own
+// realtime services run SCHED_FIFO on purpose.
+
+struct WatchdogConfig {
+	unsigned intervalMs = 1000;
+	double starvedShare = 0.5;     // run-queue delay per CPU, as a share of the interval
+	double hogShare = 0.75;        // CPU the offending thread used over the interval
+	unsigned holdSamples = 3;
+	unsigned cooldownSeconds = 30;
+	DWORD demoteTo = 2;            // Normal
+};
+
+struct WatchdogEvent {
+	enum Kind { Demoted, Restored, Failed };
+	Kind kind = Demoted;
+	int pid = 0;
+	std::string name;
+	DWORD from = 0, to = 0;  // CpuPriorityClass values
+	int cpu = -1;            // starved CPU; -1 with pressure stall information
+	double delay = 0;        // its run-queue delay over the last interval, as a share of it
+	double used = 0;         // what the offending thread used of it
+};
+
+class StarvationWatchdog {
+public:
+	explicit StarvationWatchdog(const WatchdogConfig& config = WatchdogConfig()) : config(config) {}
+
+	const WatchdogConfig& Config() const { return config; }
+	bool PerCpu() const { return source == Source::SchedStat; }
+	bool Available(); // false when neither /proc/schedstat nor /proc/pressure/cpu can be read
+
+	// One sample: demotions and the restores whose cool-down ended
+	std::vector<WatchdogEvent> Sample(const RuleTable& rules);
+
+	// A demoted process enforcement must leave alone until it is restored
+	bool Holds(int pid) const { return demoted.count(pid) != 0; }
+
+private:
+	enum class Source : unsigned char { Unknown, SchedStat, Pressure, None };
+
+	struct Thread {
+		uint64_t cpuNs = 0;
+		uint64_t pass = 0;
+	};
+	struct Hog {
+		int pid = 0, cpu = -1;
+		DWORD priority = 0;  // class it runs at
+		double used = 0;
+		std::string name;
+	};
+	struct Demotion {
+		uint64_t startTime = 0;  // tells a reused PID apart
+		uint64_t untilNs = 0;
+		std::string name;
+	};
+
+	bool ReadDelays(std::vector<uint64_t>& delays); // cumulative ns per CPU, or one total
+	void FindHogs(const RuleTable& rules, uint64_t elapsedNs, std::vector<Hog>& hogs);
+	void Restore(const RuleTable& rules, uint64_t nowNs, std::vector<WatchdogEvent>& events);
+
+	WatchdogConfig config;
+	Source source = Source::Unknown;
+	std::vector<uint64_t> lastDelays;
+	std::vector<unsigned> starved;  // samples in a row, per entry of lastDelays
+	uint64_t sampledNs = 0;
+	uint64_t pass = 0;
+	std::unordered_map<int, Thread> threads; // tid
+	std::unordered_map<int, Demotion> demoted; // pid
+};
+#else
+class StarvationWatchdog; // Linux only; where one is taken it is nullptr
+#endif
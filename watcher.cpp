@@ -0,0 +1,156 @@
+#include "watcher.h"
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+constexpr int COALESCE_MS = 200; // wait for a burst of writes to settle before reporting
+
+SnapshotDiff DiffSnapshots(const std::vector<AppRecord>& before, const std::vector<AppRecord>& after) {
+	std::unordered_map<std::wstring, const AppRecord*> old;
+	old.reserve(before.size());
+	for (const auto& app : before)
+		old.emplace(FoldCase(app.name), &app);
+
+	SnapshotDiff diff;
+	for (const auto& app : after) {
+		auto it = old.find(FoldCase(app.name));
+		if (it == old.end()) {
+			diff.added.push_back(app);
+			continue;
+		}
+		if (!SameSettings(*it->second, app))
+			diff.changed.push_back(app);
+		old.erase(it);
+	}
+
+	for (const auto& gone : old)
+		diff.removed.push_back(gone.second->name);
+	return diff;
+}
+
+bool StoreWatcher::Start(PriorityStore& store, std::function<void()> callback) {
+	Stop();
+	onChange = std::move(callback);
+	stopping = false;
+
+#ifdef _WIN32
+	if (!dynamic_cast<RegistryStore*>(&store))
+		return false;
+	stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	if (!stopEvent)
+		return false;
+#else
+	auto* fileStore = dynamic_cast<FileStore*>(&store);
+	if (!fileStore)
+		return false;
+	file = std::filesystem::absolute(fileStore->Path());
+	journal = std::filesystem::absolute(fileStore->JournalPath());
+	stopFd = eventfd(0, EFD_CLOEXEC);
+	if (stopFd < 0)
+		return false;
+#endif
+
+	worker = std::thread(&StoreWatcher::Run, this);
+	return true;
+}
+
+void StoreWatcher::Stop() {
+	if (!worker.joinable())
+		return;
+
+	stopping = true;
+#ifdef _WIN32
+	SetEvent(stopEvent);
+	worker.join();
+	CloseHandle(stopEvent);
+	stopEvent = nullptr;
+#else
+	uint64_t one = 1;
+	(void)!write(stopFd, &one, sizeof(one));
+	worker.join();
+	close(stopFd);
+	stopFd = -1;
+#endif
+}
+
+#ifdef _WIN32
+void StoreWatcher::Run() {
+	HKEY hKey;
+	if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, IFEO_PATH, 0, KEY_NOTIFY, &hKey) != ERROR_SUCCESS)
+		return;
+
+	HANDLE changed = CreateEventW(NULL, FALSE, FALSE, NULL);
+	HANDLE waits[] = { stopEvent, changed };
+	const DWORD filter = REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET;
+
+	// the notification is one-shot: it is re-armed before every wait
+	bool armed = changed && RegNotifyChangeKeyValue(hKey, TRUE, filter, changed, TRUE) == ERROR_SUCCESS;
+	while (armed && !stopping) {
+		if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+			break;
+
+		// swallow the rest of the burst (an add writes several values)
+		do {
+			armed = RegNotifyChangeKeyValue(hKey, TRUE, filter, changed, TRUE) == ERROR_SUCCESS;
+		} while (armed && WaitForMultipleObjects(2, waits, FALSE, COALESCE_MS) == WAIT_OBJECT_0 + 1);
+
+		if (!stopping)
+			onChange();
+	}
+
+	if (changed) CloseHandle(changed);
+	RegCloseKey(hKey);
+}
+#else
+void StoreWatcher::Run() {
+	// FileStore replaces the file by renaming a temp file over it and appends to its journal
+	// next to it, so watch the directory
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0)
+		return;
+	std::filesystem::path directory = file.parent_path();
+	if (inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0) {
+		close(fd);
+		return;
+	}
+	const std::string fileName = file.filename().string();
+	const std::string journalName = journal.filename().string();
+
+	// true if any queued event is about our file or its journal
+	auto drain = [&]() {
+		bool ours = false;
+		alignas(inotify_event) char buffer[4096];
+		ssize_t length;
+		while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+			for (char* p = buffer; p < buffer + length;) {
+				auto* event = reinterpret_cast<inotify_event*>(p);
+				if (event->len && (fileName == event->name || journalName == event->name))
+					ours = true;
+				p += sizeof(inotify_event) + event->len;
+			}
+		}
+		return ours;
+	};
+
+	pollfd fds[] = { { stopFd, POLLIN, 0 }, { fd, POLLIN, 0 } };
+	while (!stopping) {
+		if (poll(fds, 2, -1) < 0 || (fds[0].revents & POLLIN))
+			break;
+		if (!drain())
+			continue;
+
+		// swallow the rest of the burst
+		while (!stopping && poll(fds, 2, COALESCE_MS) > 0 && !(fds[0].revents & POLLIN))
+			drain();
+
+		if (!stopping)
+			onChange();
+	}
+	close(fd);
+}
+#endif
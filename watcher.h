@@ -0,0 +1,48 @@
+#pragma once
+
+#include "store.h"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What changed between two snapshots, keyed by app name (case-insensitive)
+struct SnapshotDiff {
+	std::vector<AppRecord> added;
+	std::vector<AppRecord> changed;
+	std::vector<std::wstring> removed;
+
+	bool Empty() const { return added.empty() && changed.empty() && removed.empty(); }
+};
+
+SnapshotDiff DiffSnapshots(const std::vector<AppRecord>& before, const std::vector<AppRecord>& after);
+
+// Background thread that calls onChange (on that thread) after the store's backing
+// data was modified by anyone, this process included. Bursts of writes are coalesced.
+// RegistryStore is watched with RegNotifyChangeKeyValue, FileStore with inotify;
+// a plain MemoryStore has nothing external to watch and Start returns false.
+class StoreWatcher {
+public:
+	StoreWatcher() = default;
+	~StoreWatcher() { Stop(); }
+	StoreWatcher(const StoreWatcher&) = delete;
+	StoreWatcher& operator=(const StoreWatcher&) = delete;
+
+	bool Start(PriorityStore& store, std::function<void()> onChange);
+	void Stop();
+
+private:
+	void Run();
+
+	std::function<void()> onChange;
+	std::thread worker;
+	std::atomic<bool> stopping{ false };
+#ifdef _WIN32
+	HANDLE stopEvent = nullptr;
+#else
+	std::filesystem::path file;
+	std::filesystem::path journal;
+	int stopFd = -1;
+#endif
+};